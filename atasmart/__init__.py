@@ -1 +1,3 @@
-from smart import Smart
\ No newline at end of file
+from _atasmart import Fleet
+from smart import Smart
+from scheduler import Scheduler, PollResult
\ No newline at end of file
@@ -0,0 +1,306 @@
+import heapq
+import logging
+import random
+import threading
+import time
+from collections import namedtuple
+from Queue import Queue
+
+import _atasmart
+from smart import Smart
+
+log = logging.getLogger(__name__)
+
+PollResult = namedtuple('PollResult', [
+    'dev_path', 'enclosure', 'timestamp', 'awake', 'overall',
+    'attributes', 'error', 'interval'])
+
+# Attributes whose normalized value moves on healthy disks and so says
+# nothing about how fast a drive is deteriorating.
+VOLATILITY_IGNORED = frozenset([
+    9,      # Power-on hours
+    12,     # Power cycle count
+    190,    # Airflow temperature
+    193,    # Load cycle count
+    194,    # Temperature
+    241,    # Total LBAs written
+    242,    # Total LBAs read
+])
+
+# Fraction of the base interval used for each overall status.
+OVERALL_FACTOR = {
+    _atasmart.OVERALL_GOOD: 1.0,
+    _atasmart.OVERALL_BAD_ATTRIBUTE_IN_THE_PAST: 0.5,
+    _atasmart.OVERALL_BAD_SECTOR: 0.25,
+    _atasmart.OVERALL_BAD_ATTRIBUTE_NOW: 0.0,
+    _atasmart.OVERALL_BAD_SECTOR_MANY: 0.0,
+    _atasmart.OVERALL_BAD_STATUS: 0.0,
+}
+
+
+class _Disk(object):
+    def __init__(self, dev_path, enclosure):
+        self.dev_path = dev_path
+        self.enclosure = enclosure
+        self.values = None
+        self.volatility = 0.0
+        self.stable = 0
+        self.interval = None
+        self.removed = False
+
+
+class Scheduler(object):
+    '''
+    Polls a set of disks, each at its own interval.
+
+    The interval of a disk shrinks from base_interval towards
+    min_interval as its overall status gets worse and as its normalized
+    attribute values change between polls.  A good disk whose values did
+    not change grows its interval by backoff per such poll, up to
+    max_interval.  Sleeping disks are left alone for sleep_interval so
+    that polling does not spin them up.  Every interval is jittered by
+    +/- jitter.
+
+    Each of the workers threads polls one disk at a time.  The extension
+    releases the GIL while it talks to a device, so polls of different
+    disks overlap.  At most max_concurrency disks of one enclosure are
+    polled at the same time.  Disks added without an enclosure are only
+    limited by the number of workers.
+
+    Each poll produces a PollResult which is passed to callback and/or
+    put on queue.  An exception raised by the poll is reported in
+    PollResult.error, one raised by callback is logged; neither takes the
+    disk out of the schedule.  A disk whose power mode cannot be checked
+    is read as if awake, with awake None and the failure in error.
+    '''
+
+    def __init__(self, callback=None, queue=None, base_interval=600.0,
+                 min_interval=60.0, max_interval=3600.0,
+                 sleep_interval=None, jitter=0.2, max_concurrency=1,
+                 workers=4, volatility_decay=0.5, backoff=2.0):
+        if callback is None and queue is None:
+            queue = Queue()
+        if not 0 <= jitter < 1:
+            raise ValueError('jitter must be in [0, 1)')
+        if backoff < 1:
+            raise ValueError('backoff must be at least 1')
+        self.callback = callback
+        self.queue = queue
+        self.base_interval = float(base_interval)
+        self.min_interval = float(min_interval)
+        self.max_interval = float(max_interval)
+        if sleep_interval is None:
+            sleep_interval = max_interval
+        self.sleep_interval = float(sleep_interval)
+        self.jitter = jitter
+        self.max_concurrency = max_concurrency
+        self.volatility_decay = volatility_decay
+        self.backoff = float(backoff)
+
+        self.__disks = {}
+        self.__heap = []
+        self.__seq = 0
+        self.__active = {}
+        self.__blocked = {}
+        self.__cond = threading.Condition()
+        self.__work = Queue()
+        self.__stopped = True
+        self.__threads = []
+        self.__worker_count = workers
+
+    def add(self, dev_path, enclosure=None):
+        with self.__cond:
+            if dev_path in self.__disks:
+                raise ValueError('{0} is already scheduled'.format(dev_path))
+            disk = _Disk(dev_path, enclosure)
+            self.__disks[dev_path] = disk
+            # Spread the first polls over min_interval so that starting
+            # up does not hit every bay at once.
+            self.__push(disk, time.time() + random.uniform(0, self.min_interval))
+            self.__cond.notify()
+
+    def remove(self, dev_path):
+        with self.__cond:
+            disk = self.__disks.pop(dev_path)
+            disk.removed = True
+
+    @property
+    def disks(self):
+        with self.__cond:
+            return list(self.__disks)
+
+    def start(self):
+        with self.__cond:
+            if not self.__stopped:
+                return
+            self.__stopped = False
+        self.__threads = [threading.Thread(target=self.__dispatch)]
+        for i in range(self.__worker_count):
+            self.__threads.append(threading.Thread(target=self.__worker))
+        for t in self.__threads:
+            t.daemon = True
+            t.start()
+
+    def stop(self):
+        with self.__cond:
+            if self.__stopped:
+                return
+            self.__stopped = True
+            # Blocked disks wait for a poll that will not finish now
+            for entries in self.__blocked.itervalues():
+                for entry in entries:
+                    heapq.heappush(self.__heap, entry)
+            self.__blocked.clear()
+            self.__cond.notify_all()
+        for i in range(self.__worker_count):
+            self.__work.put(None)
+        for t in self.__threads:
+            t.join()
+        self.__threads = []
+
+    def __enter__(self):
+        self.start()
+        return self
+
+    def __exit__(self, type, value, tb):
+        self.stop()
+        return False
+
+    def interval_for(self, overall, volatility, stable=0):
+        '''
+        Un-jittered poll interval for a disk in the given state, stable
+        being the number of polls in a row it was good and unchanged.
+        '''
+        factor = OVERALL_FACTOR.get(overall, 0.0)
+        interval = self.base_interval * factor / (1.0 + volatility)
+        if stable and overall == _atasmart.OVERALL_GOOD:
+            # Capped so that the power cannot overflow
+            interval *= self.backoff ** min(stable, 64)
+        return min(self.max_interval, max(self.min_interval, interval))
+
+    def __push(self, disk, due):
+        self.__seq += 1
+        heapq.heappush(self.__heap, (due, self.__seq, disk))
+
+    def __jittered(self, interval):
+        return interval * random.uniform(1 - self.jitter, 1 + self.jitter)
+
+    def __acquire(self, disk):
+        enclosure = disk.enclosure
+        if enclosure is None:
+            return True
+        active = self.__active.get(enclosure, 0)
+        if active >= self.max_concurrency:
+            return False
+        self.__active[enclosure] = active + 1
+        return True
+
+    def __release(self, disk):
+        enclosure = disk.enclosure
+        if enclosure is None:
+            return
+        self.__active[enclosure] -= 1
+        # Hand the slot to the longest waiting disk of the enclosure
+        entries = self.__blocked.get(enclosure)
+        while entries:
+            entry = entries.pop(0)
+            if not entry[2].removed:
+                self.__active[enclosure] += 1
+                self.__work.put(entry[2])
+                break
+        if not entries:
+            self.__blocked.pop(enclosure, None)
+
+    def __dispatch(self):
+        with self.__cond:
+            while not self.__stopped:
+                now = time.time()
+                while self.__heap and self.__heap[0][0] <= now:
+                    entry = heapq.heappop(self.__heap)
+                    disk = entry[2]
+                    if disk.removed:
+                        continue
+                    if self.__acquire(disk):
+                        self.__work.put(disk)
+                    else:
+                        # Woken up by a finishing poll of the enclosure
+                        self.__blocked.setdefault(disk.enclosure, []).append(entry)
+
+                if self.__heap:
+                    self.__cond.wait(max(0, self.__heap[0][0] - now))
+                else:
+                    self.__cond.wait()
+
+    def __worker(self):
+        while True:
+            disk = self.__work.get()
+            if disk is None:
+                return
+            try:
+                result = self.__poll(disk)
+            finally:
+                with self.__cond:
+                    self.__release(disk)
+            if result is None:
+                continue
+            if self.callback is not None:
+                try:
+                    self.callback(result)
+                except Exception:
+                    log.exception('Poll callback failed for %s', result.dev_path)
+            if self.queue is not None:
+                self.queue.put(result)
+
+    def __poll(self, disk):
+        awake = overall = attributes = error = None
+        interval = self.base_interval
+        try:
+            try:
+                with Smart(disk.dev_path) as d:
+                    try:
+                        awake = d.sleep_mode
+                    except (_atasmart.error, EnvironmentError), e:
+                        # Some disks and bridges reject CHECK POWER MODE,
+                        # read them anyway and leave awake unknown.
+                        error = e
+                    if awake is not False:
+                        d.read_data()
+                        overall = d.overall_health
+                        attributes = d.get_attributes()
+                if awake is False:
+                    interval = self.sleep_interval
+                else:
+                    self.__update_volatility(disk, overall, attributes)
+                    interval = self.interval_for(overall, disk.volatility,
+                                                 disk.stable)
+            except Exception, e:
+                error = e
+        finally:
+            now = time.time()
+            with self.__cond:
+                removed = disk.removed
+                if not removed:
+                    disk.interval = interval
+                    self.__push(disk, now + self.__jittered(interval))
+                    self.__cond.notify()
+
+        if removed:
+            return None
+        return PollResult(disk.dev_path, disk.enclosure, now, awake,
+                          overall, attributes, error, interval)
+
+    def __update_volatility(self, disk, overall, attributes):
+        values = dict((k, v['value']) for k, v in attributes.iteritems()
+                      if k not in VOLATILITY_IGNORED)
+        if disk.values is None:
+            disk.stable = 0
+        else:
+            changed = sum(1 for k, v in values.iteritems()
+                          if disk.values.get(k, v) != v)
+            disk.volatility = (disk.volatility * self.volatility_decay +
+                               changed)
+            if changed or overall != _atasmart.OVERALL_GOOD:
+                disk.stable = 0
+            else:
+                disk.stable += 1
+        disk.values = values
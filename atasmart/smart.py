@@ -120,6 +120,28 @@ class Smart(object):
             self.open()
         return self.__smart.get_attributes()
 
+    def visit_attributes(self, callback, fields=None, ids=None):
+        if not self.opened:
+            self.open()
+        return self.__smart.visit_attributes(callback, fields, ids)
+
+    def to_json(self, human_readable=False):
+        if not self.opened:
+            self.open()
+        return self.__smart.to_json(human_readable)
+
+    def to_msgpack(self, human_readable=False):
+        if not self.opened:
+            self.open()
+        return self.__smart.to_msgpack(human_readable)
+
+    def update_fleet(self, fleet, key=None, enclosure=None):
+        if not self.opened:
+            self.open()
+        if key is None:
+            key = self.__dev_path
+        fleet.update(key, self.__smart, enclosure)
+
     def is_value_reached(self, id, value):
         if not self.opened:
             self.open()
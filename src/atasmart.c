@@ -6,19 +6,38 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <math.h>
 
 #include <atasmart.h>
 
 #include <Python.h>
+#include <pythread.h>
+
+#include "sim.h"
+#include "vendor.h"
+#include "encode.h"
+#include "sgio.h"
+#include "fleet.h"
 
 #define UNUSED __attribute__ (( __unused__ ))
 
 typedef struct {
     PyObject_HEAD
     SkDisk *d;
+    SimDisk *sim;
     PyObject *attr_parse_callback;
+    VendorTable vendor;
+    int vendor_resolved;
+    PyThread_type_lock lock;
+    long owner;                     /* thread holding lock */
+    int depth;                      /* times owner acquired it */
 } Smart;
 
+typedef struct {
+    PyObject *attr_dict;
+    const VendorDecoder **vendor;
+} AttributeDump;
+
 static int       Smart_init(Smart*, PyObject*, PyObject*);
 static PyObject *to_human_readable_string(uint64_t pretty_value, SkSmartAttributeUnit pretty_unit);
 static PyObject* Smart_get_power_on(Smart*, PyObject*, PyObject*);
@@ -29,11 +48,75 @@ static PyObject* Smart_smart_is_available(Smart* );
 static PyObject* Smart_smart_status(Smart*);
 static void      Smart_dealloc(Smart*);
 static PyObject* Smart_error;
+static PyTypeObject PyType_Smart;
 
 static char* SMART_DOC_STRING =
     "Python Binding for libatasmart\n"
 ;
 
+/*
+ * Device I/O, real or simulated, runs without the GIL so that threads
+ * using different disks overlap.  Every method holds the disk lock
+ * meanwhile, so another thread cannot use or free self->d under it.  The
+ * lock is recursive, callbacks and finalizers may use the disk again.
+ */
+static int Smart_acquire(Smart* self)
+{
+    long thread = PyThread_get_thread_ident();
+
+    if (!self->lock && !(self->lock = PyThread_allocate_lock())) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    if (self->depth && self->owner == thread) {
+        self->depth++;
+        return 0;
+    }
+
+    if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+    self->owner = thread;
+    self->depth = 1;
+    return 0;
+}
+
+static void Smart_release(Smart* self)
+{
+    if (!--self->depth)
+        PyThread_release_lock(self->lock);
+}
+
+/* Freeing or reloading self->d is refused while a caller further up the
+ * stack, visit_attributes() running its callback say, still walks it */
+static int Smart_check_reentry(Smart* self)
+{
+    if (self->depth > 1) {
+        PyErr_SetString(Smart_error, self->attr_parse_callback ?
+                        "Disk is busy in visit_attributes" : "Disk is busy");
+        return -1;
+    }
+    return 0;
+}
+
+/* The simulated latency stands in for device I/O, so it runs without the
+ * GIL as well */
+static int Smart_sim_io(Smart* self)
+{
+    int ret;
+
+    if (!self->sim)
+        return 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = sim_disk_io(self->sim);
+    Py_END_ALLOW_THREADS
+    return ret;
+}
+
 static int Smart_init(Smart* self, PyObject* args, UNUSED PyObject* kargs)
 {
     char *device;
@@ -44,8 +127,34 @@ static int Smart_init(Smart* self, PyObject* args, UNUSED PyObject* kargs)
         return -1;
     }
 
+    if (Smart_acquire(self) < 0)
+        return -1;
+
+    if (Smart_check_reentry(self) < 0) {
+        Smart_release(self);
+        return -1;
+    }
+
+    /* Calling __init__ again replaces the device, simulated or not */
+    if (self->d) {
+        sk_disk_free(self->d);
+        self->d = NULL;
+    }
+    sim_disk_free(self->sim);
+    self->sim = NULL;
+    self->vendor_resolved = 0;
+
+    /* Opening reads the identify data from the device */
+    Py_BEGIN_ALLOW_THREADS
+    if (!strncmp(device, SIM_PREFIX, strlen(SIM_PREFIX)))
+        ret = sim_disk_open(device + strlen(SIM_PREFIX), &self->sim, &self->d);
+    else
+        ret = sk_disk_open(device, &(self->d));
+    Py_END_ALLOW_THREADS
+
+    Smart_release(self);
 
-    if ((ret = sk_disk_open(device, &(self->d))) < 0) {
+    if (ret < 0) {
         PyErr_Format(Smart_error, "Failed to open disk: (%d) %s", errno, strerror(errno));
         return -1;
     }
@@ -56,7 +165,18 @@ static int Smart_init(Smart* self, PyObject* args, UNUSED PyObject* kargs)
 static PyObject* Smart_read_data(Smart* self)
 {
     int ret;
-    if ((ret = sk_disk_smart_read_data(self->d)) < 0) {
+
+    if (Smart_check_reentry(self) < 0)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (self->sim)
+        ret = sim_disk_read_data(self->sim, self->d);
+    else
+        ret = sk_disk_smart_read_data(self->d);
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
         PyErr_Format(Smart_error, "Failed to read SMART data: (%d) %s", errno, strerror(errno));
         return NULL;
     }
@@ -67,11 +187,16 @@ static PyObject* Smart_read_data(Smart* self)
 
 static PyObject* Smart_close(Smart* self)
 {
+	if (Smart_check_reentry(self) < 0)
+		return NULL;
+
 	if (self->d)
 	{
 		sk_disk_free(self->d);
 		self->d = NULL;
 	}
+	sim_disk_free(self->sim);
+	self->sim = NULL;
 
     Py_RETURN_NONE;
 }
@@ -84,6 +209,12 @@ static void Smart_dealloc(Smart* self)
 		sk_disk_free(self->d);
 		self->d = NULL;
 	}
+	sim_disk_free(self->sim);
+	self->sim = NULL;
+	Py_CLEAR(self->attr_parse_callback);
+	if (self->lock)
+		PyThread_free_lock(self->lock);
+	self->ob_type->tp_free((PyObject*) self);
 }
 
 //Get the power-on time        
@@ -98,7 +229,7 @@ static PyObject* Smart_get_power_on(Smart* self, PyObject* args, PyObject* kwarg
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
         return NULL;
 
-    if ((ret = sk_disk_smart_get_power_on(self->d, &ms)) < 0) {
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_smart_get_power_on(self->d, &ms)) < 0) {
         PyErr_Format(Smart_error, "Failed to get power on time: (%d) %s", errno, strerror(errno));
         return NULL;
     }
@@ -114,7 +245,7 @@ static PyObject* Smart_get_power_cycle(Smart* self)
     int ret;
     uint64_t count;
 
-    if ((ret = sk_disk_smart_get_power_cycle(self->d, &count)) < 0) {
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_smart_get_power_cycle(self->d, &count)) < 0) {
         PyErr_Format(Smart_error, "Failed to get number of power cycles: (%d) %s", errno, strerror(errno));
         return NULL;
     }
@@ -133,7 +264,7 @@ static PyObject* Smart_get_bad_sectors(Smart* self, PyObject* args, PyObject* kw
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
         return NULL;
 
-    if ((ret = sk_disk_smart_get_bad(self->d, &sectors)) < 0) {
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_smart_get_bad(self->d, &sectors)) < 0) {
         if (errno == 2) {            
         Py_INCREF(Py_None);
         return Py_None;
@@ -158,7 +289,7 @@ static PyObject* Smart_get_temperature(Smart* self, PyObject* args, PyObject* kw
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
         return NULL;
 
-    if ((ret = sk_disk_smart_get_temperature(self->d, &mkelvin)) < 0) {
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_smart_get_temperature(self->d, &mkelvin)) < 0) {
         PyErr_Format(Smart_error, "Failed to get disk temperature: (%d) %s", errno, strerror(errno));
         return NULL;
     }
@@ -173,7 +304,7 @@ static PyObject* Smart_smart_is_available(Smart* self)
     int ret;
     SkBool available;
 
-    if ((ret = sk_disk_smart_is_available(self->d, &available)) < 0) {
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_smart_is_available(self->d, &available)) < 0) {
         PyErr_Format(Smart_error, "Unable to check if SMART is available: (%d) %s", errno, strerror(errno));
         return NULL;
     }
@@ -186,7 +317,13 @@ static PyObject* Smart_smart_status(Smart* self)
     int ret;
     SkBool statusGood;
 
-    if ((ret = sk_disk_smart_status(self->d, &statusGood)) < 0) {
+    if ((ret = Smart_sim_io(self)) >= 0) {
+        Py_BEGIN_ALLOW_THREADS
+        ret = sk_disk_smart_status(self->d, &statusGood);
+        Py_END_ALLOW_THREADS
+    }
+
+    if (ret < 0) {
         PyErr_Format(Smart_error, "Failed to get SMART status: (%d) %s", errno, strerror(errno));
         return NULL;  
     }
@@ -198,7 +335,14 @@ static PyObject* Smart_check_sleep_mode(Smart* self)
     int ret;
     SkBool awake;
 
-    if ((ret = sk_disk_check_sleep_mode(self->d, &awake)) < 0) {
+    Py_BEGIN_ALLOW_THREADS
+    if (self->sim)
+        ret = sim_disk_check_sleep_mode(self->sim, &awake);
+    else
+        ret = sk_disk_check_sleep_mode(self->d, &awake);
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
         PyErr_Format(Smart_error, "Failed to check sleep mode: (%d) %s", errno, strerror(errno));
         return NULL;  
     }
@@ -210,7 +354,7 @@ static PyObject* Smart_identify_is_available(Smart* self)
     int ret;
     SkBool available;
 
-    if ((ret = sk_disk_identify_is_available(self->d, &available)) < 0) {
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_identify_is_available(self->d, &available)) < 0) {
         PyErr_Format(Smart_error, "Failed to check identify data available: (%d) %s", errno, strerror(errno));
         return NULL;  
     }
@@ -228,7 +372,14 @@ static PyObject* Smart_get_overall(Smart* self, PyObject* args, PyObject* kwargs
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
         return NULL;
 
-    if ((ret = sk_disk_smart_get_overall(self->d, &overall)) < 0) {
+    /* Asks the device for its SMART status */
+    if ((ret = Smart_sim_io(self)) >= 0) {
+        Py_BEGIN_ALLOW_THREADS
+        ret = sk_disk_smart_get_overall(self->d, &overall);
+        Py_END_ALLOW_THREADS
+    }
+
+    if (ret < 0) {
         PyErr_Format(Smart_error, "Failed to get overall status: (%d) %s", errno, strerror(errno));
         return NULL;  
     }
@@ -250,7 +401,14 @@ static PyObject* Smart_get_size(Smart* self, PyObject* args, PyObject* kwargs)
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
         return NULL;
 
-    if ((ret = sk_disk_get_size(self->d, &size)) < 0) {
+    Py_BEGIN_ALLOW_THREADS
+    if (self->sim)
+        ret = sim_disk_get_size(self->sim, &size);
+    else
+        ret = sk_disk_get_size(self->d, &size);
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
         PyErr_Format(Smart_error, "Failed to get size: (%d) %s", errno, strerror(errno));
         return NULL;  
     }
@@ -260,103 +418,105 @@ static PyObject* Smart_get_size(Smart* self, PyObject* args, PyObject* kwargs)
         return PyInt_FromLong(size);
 }
 
-static PyObject *to_human_readable_string(uint64_t pretty_value, SkSmartAttributeUnit pretty_unit) 
+static void format_human_readable(char *buf, size_t len, uint64_t pretty_value, SkSmartAttributeUnit pretty_unit)
 {
-    PyObject *str = NULL;
-    char fmt_value[32];
-
         switch (pretty_unit) {
                 case SK_SMART_ATTRIBUTE_UNIT_MSECONDS:
 
                         if (pretty_value >= 1000LLU*60LLU*60LLU*24LLU*365LLU)
-                        {
-                                PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.1f years", ((double) pretty_value)/(1000.0*60*60*24*365));
-                                str = PyString_FromFormat(fmt_value);
-                        }
+                                PyOS_snprintf(buf, len, "%0.1f years", ((double) pretty_value)/(1000.0*60*60*24*365));
                         else if (pretty_value >= 1000LLU*60LLU*60LLU*24LLU*30LLU)
-                        {
-                                PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.1f months", ((double) pretty_value)/(1000.0*60*60*24*30));
-                                str = PyString_FromFormat(fmt_value);
-                        }
+                                PyOS_snprintf(buf, len, "%0.1f months", ((double) pretty_value)/(1000.0*60*60*24*30));
                         else if (pretty_value >= 1000LLU*60LLU*60LLU*24LLU)
-                        {
-                                PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.1f days", ((double) pretty_value)/(1000.0*60*60*24));
-                                str = PyString_FromFormat(fmt_value);
-                        }
+                                PyOS_snprintf(buf, len, "%0.1f days", ((double) pretty_value)/(1000.0*60*60*24));
                         else if (pretty_value >= 1000LLU*60LLU*60LLU)
-                        {
-                                PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.1f h", ((double) pretty_value)/(1000.0*60*60));
-                                str = PyString_FromFormat(fmt_value);
-                        }
+                                PyOS_snprintf(buf, len, "%0.1f h", ((double) pretty_value)/(1000.0*60*60));
                         else if (pretty_value >= 1000LLU*60LLU)
-                        {
-                                PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.1f min", ((double) pretty_value)/(1000.0*60));
-                                str = PyString_FromFormat(fmt_value);
-                        }
+                                PyOS_snprintf(buf, len, "%0.1f min", ((double) pretty_value)/(1000.0*60));
                         else if (pretty_value >= 1000LLU)
-                        {
-                                PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.1f s", ((double) pretty_value)/(1000.0));
-                                str = PyString_FromFormat(fmt_value);
-                        }
+                                PyOS_snprintf(buf, len, "%0.1f s", ((double) pretty_value)/(1000.0));
                         else
-                        {
-                                str = PyString_FromFormat("%llu ms", (unsigned long long) pretty_value);
-                        }
+                                PyOS_snprintf(buf, len, "%llu ms", (unsigned long long) pretty_value);
 
                         break;
 
                 case SK_SMART_ATTRIBUTE_UNIT_MKELVIN:
-                        PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.1f C", ((double) pretty_value - 273150) / 1000);
-                        str = PyString_FromFormat(fmt_value);
+                        PyOS_snprintf(buf, len, "%0.1f C", ((double) pretty_value - 273150) / 1000);
                         break;
 
                 case SK_SMART_ATTRIBUTE_UNIT_SECTORS:
-                        str = PyString_FromFormat("%llu sectors", (unsigned long long) pretty_value);
+                        PyOS_snprintf(buf, len, "%llu sectors", (unsigned long long) pretty_value);
                         break;
 
                 case SK_SMART_ATTRIBUTE_UNIT_PERCENT:
-                        str = PyString_FromFormat("%llu%%", (unsigned long long) pretty_value);
+                        PyOS_snprintf(buf, len, "%llu%%", (unsigned long long) pretty_value);
                         break;
 
                 case SK_SMART_ATTRIBUTE_UNIT_SMALL_PERCENT:
-                        PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.3f%%", (double) pretty_value);
-                        str = PyString_FromFormat(fmt_value);
+                        PyOS_snprintf(buf, len, "%0.3f%%", (double) pretty_value);
                         break;
 
                 case SK_SMART_ATTRIBUTE_UNIT_MB:
                         if (pretty_value >= 1000000LLU)
-                        {
-                          PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.3f TB",  (double) pretty_value / 1000000LLU);
-                            str = PyString_FromFormat(fmt_value);
-                        }
+                          PyOS_snprintf(buf, len, "%0.3f TB",  (double) pretty_value / 1000000LLU);
                         else if (pretty_value >= 1000LLU)
-                        {
-                          PyOS_snprintf(fmt_value, sizeof(fmt_value), "%0.3f GB",  (double) pretty_value / 1000LLU);
-                            str = PyString_FromFormat(fmt_value);
-                        }
+                          PyOS_snprintf(buf, len, "%0.3f GB",  (double) pretty_value / 1000LLU);
                         else
-                        {
-                          str = PyString_FromFormat("%llu MB", (unsigned long long) pretty_value);
-                        }
+                          PyOS_snprintf(buf, len, "%llu MB", (unsigned long long) pretty_value);
                         break;
 
                 case SK_SMART_ATTRIBUTE_UNIT_NONE:
-                        str = PyString_FromFormat("%llu", (unsigned long long) pretty_value);
+                        PyOS_snprintf(buf, len, "%llu", (unsigned long long) pretty_value);
                         break;
 
                 case SK_SMART_ATTRIBUTE_UNIT_UNKNOWN:
-                        str = PyString_FromFormat("n/a");
+                default:
+                        PyOS_snprintf(buf, len, "n/a");
                         break;
-
-                case _SK_SMART_ATTRIBUTE_UNIT_MAX:
-                        assert(FALSE);
         }
+}
+
+static PyObject *to_human_readable_string(uint64_t pretty_value, SkSmartAttributeUnit pretty_unit) 
+{
+    char fmt_value[32];
+
+    format_human_readable(fmt_value, sizeof(fmt_value), pretty_value, pretty_unit);
+    return PyString_FromString(fmt_value);
+}
+
+static PyObject *_vendor_fields(const VendorDecoder *v, const SkSmartAttributeParsedData *a)
+{
+    PyObject *fields, *value;
+    int i;
+
+    fields = PyDict_New();
+    for (i = 0; i < VENDOR_MAX_FIELDS && v->fields[i].name; i++) {
+        value = PyLong_FromUnsignedLongLong(vendor_field_value(&v->fields[i], a->raw));
+        PyDict_SetItemString(fields, v->fields[i].name, value);
+        Py_DECREF(value);
+    }
+    return fields;
+}
+
+static void _disk_dump_vendor_fields(PyObject *dict, const VendorDecoder *v, const SkSmartAttributeParsedData *a)
+{
+    PyObject *fields, *value;
+
+    value = PyLong_FromUnsignedLongLong(vendor_raw48(a->raw));
+    PyDict_SetItemString(dict, "raw_int", value);
+    Py_DECREF(value);
 
-        return str;
+    if (!v)
+        return;
+
+    fields = _vendor_fields(v, a);
+    PyDict_SetItemString(dict, "fields", fields);
+    Py_DECREF(fields);
 }
 
 static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a, void* userdata) {
-    PyObject* attr_dict = userdata;
+    AttributeDump* dump = userdata;
+    PyObject* attr_dict = dump->attr_dict;
     PyObject* dict = NULL;
 
     if (!PyDict_CheckExact(attr_dict))
@@ -381,7 +541,7 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
     if (a->current_value_valid) {
         PyDict_SetItem(dict, 
             Py_BuildValue("s", "value"), 
-            Py_BuildValue("b", a->current_value));
+            Py_BuildValue("B", a->current_value));
 
     } else {
         PyDict_SetItem(dict, 
@@ -393,7 +553,7 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
     if (a->worst_value_valid) {
         PyDict_SetItem(dict, 
             Py_BuildValue("s", "worst"), 
-            Py_BuildValue("b", a->worst_value));
+            Py_BuildValue("B", a->worst_value));
 
     } else {
         PyDict_SetItem(dict, 
@@ -404,7 +564,7 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
     if (a->threshold_valid) {
         PyDict_SetItem(dict, 
             Py_BuildValue("s", "threshold"), 
-            Py_BuildValue("b", a->threshold));
+            Py_BuildValue("B", a->threshold));
 
     } else {
         PyDict_SetItem(dict, 
@@ -426,7 +586,9 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
 
     PyDict_SetItem(dict, 
         Py_BuildValue("s", "raw"), 
-        Py_BuildValue("bbbbbb", a->raw[0], a->raw[1], a->raw[2], a->raw[3], a->raw[4], a->raw[5]));
+        Py_BuildValue("BBBBBB", a->raw[0], a->raw[1], a->raw[2], a->raw[3], a->raw[4], a->raw[5]));
+
+    _disk_dump_vendor_fields(dict, dump->vendor[a->id], a);
 
     PyDict_SetItem(dict, 
         Py_BuildValue("s", "updates"), 
@@ -466,7 +628,7 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
     if (a->good_now_valid) {
         PyDict_SetItem(dict, 
             Py_BuildValue("s", "good"), 
-            Py_BuildValue("O", PyBool_FromLong(a->good_now_valid)));
+            Py_BuildValue("O", PyBool_FromLong(a->good_now)));
 
     } else {
         PyDict_SetItem(dict, 
@@ -477,7 +639,7 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
     if (a->good_in_the_past_valid) {
         PyDict_SetItem(dict, 
             Py_BuildValue("s", "past"), 
-            Py_BuildValue("O", PyBool_FromLong(a->good_in_the_past_valid)));
+            Py_BuildValue("O", PyBool_FromLong(a->good_in_the_past)));
 
     } else {
         PyDict_SetItem(dict, 
@@ -486,7 +648,7 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
     }
 
     PyDict_SetItem(attr_dict, 
-        Py_BuildValue("b", a->id),
+        Py_BuildValue("B", a->id),
 		dict);
     Py_INCREF(dict);
 /*
@@ -499,14 +661,30 @@ static void _disk_dump_attributes(SkDisk *d, const SkSmartAttributeParsedData *a
 }
 
 
+/* Resolve the vendor decoders for this disk's model once */
+static const VendorDecoder **Smart_vendor_table(Smart* self)
+{
+    const SkIdentifyParsedData *ipd;
+
+    if (!self->vendor_resolved) {
+        vendor_resolve(sk_disk_identify_parse(self->d, &ipd) < 0 ? "" : ipd->model, self->vendor);
+        self->vendor_resolved = 1;
+    }
+    return self->vendor;
+}
+
 static PyObject* Smart_get_attributes(Smart* self)
 {
     int ret;
     PyObject *attr_dict = NULL;
+    AttributeDump dump;
 
     attr_dict = PyDict_New();
+    dump.attr_dict = attr_dict;
+    dump.vendor = Smart_vendor_table(self);
 
-    if ((ret = sk_disk_smart_parse_attributes(self->d, _disk_dump_attributes, attr_dict)) < 0)
+    if ((ret = Smart_sim_io(self)) < 0 ||
+        (ret = sk_disk_smart_parse_attributes(self->d, _disk_dump_attributes, &dump)) < 0)
     {
         PyErr_SetString(Smart_error, "SMART Attribute parsing error");
         return NULL;
@@ -515,195 +693,1536 @@ static PyObject* Smart_get_attributes(Smart* self)
     return attr_dict;
 }
 
-static PyObject* Smart_get_info(Smart* self, PyObject* args, PyObject* kwargs)
+enum {
+    ATTRIBUTE_FIELD_ID,
+    ATTRIBUTE_FIELD_NAME,
+    ATTRIBUTE_FIELD_VALUE,
+    ATTRIBUTE_FIELD_WORST,
+    ATTRIBUTE_FIELD_THRESHOLD,
+    ATTRIBUTE_FIELD_UNIT,
+    ATTRIBUTE_FIELD_HUMAN_READABLE,
+    ATTRIBUTE_FIELD_FORMATTED_VALUE,
+    ATTRIBUTE_FIELD_RAW,
+    ATTRIBUTE_FIELD_RAW_INT,
+    ATTRIBUTE_FIELD_FIELDS,
+    ATTRIBUTE_FIELD_UPDATES,
+    ATTRIBUTE_FIELD_WARN,
+    ATTRIBUTE_FIELD_FLAGS,
+    ATTRIBUTE_FIELD_TYPE,
+    ATTRIBUTE_FIELD_FAILED,
+    ATTRIBUTE_FIELD_GOOD,
+    ATTRIBUTE_FIELD_PAST,
+    _ATTRIBUTE_FIELD_MAX
+};
+
+/* Same names and meaning as the keys of get_attributes() */
+static const char *attribute_field_names[_ATTRIBUTE_FIELD_MAX] = {
+    "id", "name", "value", "worst", "threshold", "unit", "human_readable",
+    "formatted_value", "raw", "raw_int", "fields", "updates", "warn",
+    "flags", "type", "failed", "good", "past"
+};
+
+static const int attribute_default_fields[] = {
+    ATTRIBUTE_FIELD_ID,
+    ATTRIBUTE_FIELD_NAME,
+    ATTRIBUTE_FIELD_VALUE,
+    ATTRIBUTE_FIELD_WORST,
+    ATTRIBUTE_FIELD_THRESHOLD,
+    ATTRIBUTE_FIELD_RAW_INT
+};
+
+typedef struct {
+    Smart *smart;
+    int fields[_ATTRIBUTE_FIELD_MAX];
+    int n_fields;
+    uint8_t ids[256 / 8];
+    int filter;
+    long visited;
+    int failed;
+} AttributeVisit;
+
+static PyObject *_attribute_optional_byte(int valid, uint8_t value)
 {
-    int ret;
-    const SkSmartParsedData *spd;
+    if (!valid)
+        Py_RETURN_NONE;
+    return PyInt_FromLong(value);
+}
 
-    PyObject* dict = NULL;
-    PyObject* human_readable = NULL;
+static PyObject *_attribute_field(int field, const SkSmartAttributeParsedData *a, const VendorDecoder *v)
+{
+    switch (field) {
+        case ATTRIBUTE_FIELD_ID:
+            return PyInt_FromLong(a->id);
+        case ATTRIBUTE_FIELD_NAME:
+            if (!a->name)
+                Py_RETURN_NONE;
+            return PyString_FromString(a->name);
+        case ATTRIBUTE_FIELD_VALUE:
+            return _attribute_optional_byte(a->current_value_valid, a->current_value);
+        case ATTRIBUTE_FIELD_WORST:
+            return _attribute_optional_byte(a->worst_value_valid, a->worst_value);
+        case ATTRIBUTE_FIELD_THRESHOLD:
+            return _attribute_optional_byte(a->threshold_valid, a->threshold);
+        case ATTRIBUTE_FIELD_UNIT:
+            return PyInt_FromLong(a->pretty_unit);
+        case ATTRIBUTE_FIELD_HUMAN_READABLE:
+            return to_human_readable_string(a->pretty_value, a->pretty_unit);
+        case ATTRIBUTE_FIELD_FORMATTED_VALUE:
+            return PyLong_FromUnsignedLongLong(a->pretty_value);
+        case ATTRIBUTE_FIELD_RAW:
+            return Py_BuildValue("BBBBBB", a->raw[0], a->raw[1], a->raw[2], a->raw[3], a->raw[4], a->raw[5]);
+        case ATTRIBUTE_FIELD_RAW_INT:
+            return PyLong_FromUnsignedLongLong(vendor_raw48(a->raw));
+        case ATTRIBUTE_FIELD_FIELDS:
+            if (!v)
+                Py_RETURN_NONE;
+            return _vendor_fields(v, a);
+        case ATTRIBUTE_FIELD_UPDATES:
+            return PyBool_FromLong(a->online);
+        case ATTRIBUTE_FIELD_WARN:
+            return PyBool_FromLong(a->warn);
+        case ATTRIBUTE_FIELD_FLAGS:
+            return PyInt_FromLong(a->flags);
+        case ATTRIBUTE_FIELD_TYPE:
+            return PyString_FromString(a->prefailure ? "prefail" : "old-age");
+        case ATTRIBUTE_FIELD_FAILED:
+            if (!a->current_value || !a->threshold)
+                Py_RETURN_NONE;
+            return PyBool_FromLong(a->current_value <= a->threshold);
+        case ATTRIBUTE_FIELD_GOOD:
+            if (!a->good_now_valid)
+                Py_RETURN_NONE;
+            return PyBool_FromLong(a->good_now);
+        case ATTRIBUTE_FIELD_PAST:
+            if (!a->good_in_the_past_valid)
+                Py_RETURN_NONE;
+            return PyBool_FromLong(a->good_in_the_past);
+    }
 
-    static char *kwlist[] = {"human_readable", NULL};
+    PyErr_SetString(Smart_error, "Unknown attribute field");
+    return NULL;
+}
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
-        return NULL;
+static void _disk_visit_attributes(UNUSED SkDisk *d, const SkSmartAttributeParsedData *a, void* userdata)
+{
+    AttributeVisit *visit = userdata;
+    PyObject *args, *item, *result;
+    int i;
 
-    dict = PyDict_New();
+    /* libatasmart cannot stop the iteration, so skip the rest after an error */
+    if (visit->failed)
+        return;
 
+    if (visit->filter && !(visit->ids[a->id / 8] & (1 << (a->id % 8))))
+        return;
 
-    if ((ret = sk_disk_smart_parse(self->d, &spd)) < 0)
-    {
-        PyErr_SetString(Smart_error, "SMART info parsing error");
-        return NULL;
+    if (!(args = PyTuple_New(visit->n_fields))) {
+        visit->failed = 1;
+        return;
     }
 
-    if (human_readable && PyObject_IsTrue(human_readable))
-        PyDict_SetItem(dict, 
-            Py_BuildValue("s", "offline_data_collection_status"), 
-            Py_BuildValue("s", sk_smart_offline_data_collection_status_to_string(spd->offline_data_collection_status)));
-    else
-        PyDict_SetItem(dict, 
-            Py_BuildValue("s", "offline_data_collection_status"), 
-            Py_BuildValue("K", spd->offline_data_collection_status));
+    for (i = 0; i < visit->n_fields; i++) {
+        if (!(item = _attribute_field(visit->fields[i], a, visit->smart->vendor[a->id]))) {
+            Py_DECREF(args);
+            visit->failed = 1;
+            return;
+        }
+        PyTuple_SET_ITEM(args, i, item);
+    }
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "total_offline_data_collection_seconds"), 
-        Py_BuildValue("K", spd->total_offline_data_collection_seconds));
+    result = PyObject_Call(visit->smart->attr_parse_callback, args, NULL);
+    Py_DECREF(args);
 
-    if (human_readable && PyObject_IsTrue(human_readable))
-        PyDict_SetItem(dict, 
-            Py_BuildValue("s", "self_test_execution_status"), 
-            Py_BuildValue("s", sk_smart_self_test_execution_status_to_string(spd->offline_data_collection_status)));
-    else
-        PyDict_SetItem(dict, 
-            Py_BuildValue("s", "self_test_execution_status"), 
-            Py_BuildValue("K", spd->self_test_execution_status));
+    if (!result) {
+        visit->failed = 1;
+        return;
+    }
+    Py_DECREF(result);
+    visit->visited++;
+}
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "self_test_execution_percent_remaining"), 
-        Py_BuildValue("K", spd->self_test_execution_percent_remaining));
+static int _parse_visit_fields(AttributeVisit *visit, PyObject *fields)
+{
+    PyObject *seq;
+    Py_ssize_t i, j, n;
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "conveyance_test_available"), 
-        Py_BuildValue("O", PyBool_FromLong(spd->conveyance_test_available)));
+    if (!fields || fields == Py_None) {
+        visit->n_fields = sizeof(attribute_default_fields) / sizeof(attribute_default_fields[0]);
+        memcpy(visit->fields, attribute_default_fields, sizeof(attribute_default_fields));
+        return 0;
+    }
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "short_and_extended_test_available"), 
-        Py_BuildValue("O", PyBool_FromLong(spd->short_and_extended_test_available)));
+    if (!(seq = PySequence_Fast(fields, "fields must be a sequence of field names")))
+        return -1;
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "start_test_available"), 
-        Py_BuildValue("O", PyBool_FromLong(spd->start_test_available)));
+    if ((n = PySequence_Fast_GET_SIZE(seq)) > _ATTRIBUTE_FIELD_MAX) {
+        PyErr_SetString(PyExc_ValueError, "too many fields");
+        Py_DECREF(seq);
+        return -1;
+    }
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "abort_test_available"), 
-        Py_BuildValue("O", PyBool_FromLong(spd->abort_test_available)));
+    for (i = 0; i < n; i++) {
+        const char *name = PyString_AsString(PySequence_Fast_GET_ITEM(seq, i));
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "short_test_polling_minutes"), 
-        Py_BuildValue("K", spd->short_test_polling_minutes));
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "extended_test_polling_minutes"), 
-        Py_BuildValue("K", spd->extended_test_polling_minutes));
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "conveyance_test_polling_minutes"), 
-        Py_BuildValue("K", spd->conveyance_test_polling_minutes));
+        if (!name) {
+            Py_DECREF(seq);
+            return -1;
+        }
 
-    return dict;
+        for (j = 0; j < _ATTRIBUTE_FIELD_MAX; j++)
+            if (!strcmp(name, attribute_field_names[j]))
+                break;
+
+        if (j == _ATTRIBUTE_FIELD_MAX) {
+            PyErr_Format(PyExc_ValueError, "unknown attribute field: %s", name);
+            Py_DECREF(seq);
+            return -1;
+        }
+        visit->fields[i] = j;
+    }
+
+    visit->n_fields = n;
+    Py_DECREF(seq);
+    return 0;
 }
 
-static PyObject* Smart_get_identify(Smart* self)
+static int _parse_visit_ids(AttributeVisit *visit, PyObject *ids)
+{
+    PyObject *iter, *item;
+
+    if (!ids || ids == Py_None)
+        return 0;
+
+    if (!(iter = PyObject_GetIter(ids)))
+        return -1;
+
+    visit->filter = 1;
+    while ((item = PyIter_Next(iter))) {
+        long id = PyInt_AsLong(item);
+
+        Py_DECREF(item);
+        if (id == -1 && PyErr_Occurred())
+            break;
+        if (id < 0 || id > 255) {
+            PyErr_Format(PyExc_ValueError, "invalid attribute id: %ld", id);
+            break;
+        }
+        visit->ids[id / 8] |= 1 << (id % 8);
+    }
+
+    Py_DECREF(iter);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+static PyObject* Smart_visit_attributes(Smart* self, PyObject* args, PyObject* kwargs)
 {
     int ret;
-    const SkIdentifyParsedData *ipd;
+    PyObject *callback = NULL;
+    PyObject *fields = NULL;
+    PyObject *ids = NULL;
+    AttributeVisit visit;
 
-    PyObject* dict = NULL;
+    static char *kwlist[] = {"callback", "fields", "ids", NULL};
 
-    dict = PyDict_New();
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OO", kwlist, &callback, &fields, &ids))
+        return NULL;
 
+    if (!PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
 
-    if ((ret = sk_disk_identify_parse(self->d, &ipd)) < 0)
-    {
-	    PyErr_SetString(Smart_error, "SMART identify  parsing error");
-	    return NULL;
+    if (self->attr_parse_callback) {
+        PyErr_SetString(Smart_error, "visit_attributes is already running");
+        return NULL;
     }
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "model"), 
-        Py_BuildValue("s", ipd->model));
+    if (!self->d) {
+        PyErr_SetString(Smart_error, "Disk is closed");
+        return NULL;
+    }
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "serial"), 
-        Py_BuildValue("s", ipd->serial));
+    memset(&visit, 0, sizeof(visit));
+    visit.smart = self;
 
-    PyDict_SetItem(dict, 
-        Py_BuildValue("s", "firmware"), 
-        Py_BuildValue("s", ipd->firmware));
+    if (_parse_visit_fields(&visit, fields) < 0 || _parse_visit_ids(&visit, ids) < 0)
+        return NULL;
 
-    return dict;
-}
+    Smart_vendor_table(self);
 
-static PyObject *Smart_self_test(Smart *self, PyObject* args, PyObject* kwargs)
-{
-    int ret;
-    char test_type = 0;
+    Py_INCREF(callback);
+    self->attr_parse_callback = callback;
 
-    static char *kwlist[] = {"test_type", NULL};
+    ret = Smart_sim_io(self);
+    if (ret >= 0)
+        ret = sk_disk_smart_parse_attributes(self->d, _disk_visit_attributes, &visit);
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "b", kwlist, &test_type))
+    self->attr_parse_callback = NULL;
+    Py_DECREF(callback);
+
+    if (visit.failed)
         return NULL;
 
-    if ((ret = sk_disk_smart_self_test(self->d, test_type)) < 0) {
-        PyErr_Format(Smart_error, "Failed to read SMART data: (%d) %s", errno, strerror(errno));
+    if (ret < 0) {
+        PyErr_SetString(Smart_error, "SMART Attribute parsing error");
         return NULL;
     }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    return PyInt_FromLong(visit.visited);
 }
-/*
-static void
-_parse_attr_cb (SkDisk                           *d,
-               const SkSmartAttributeParsedData *a,
-               void                             *user_data)
-{
-  PyObject* data = user_data;
-  gboolean failed = FALSE;
-  gboolean failed_in_the_past = FALSE;
-  gint current, worst, threshold;
 
-  current =   a->current_value_valid ? a->current_value : -1;
-  worst =     a->worst_value_valid   ? a->worst_value : -1;
-  threshold = a->threshold_valid     ? a->threshold : -1;
+/* Reused so that steady state encoding does not allocate.  Encoding
+ * releases the GIL for device I/O, a call finding it in use encodes into
+ * a buffer of its own. */
+static Encoder snapshot_encoder;
+static int snapshot_encoder_used;
 
-  g_variant_builder_add (&data->builder,
-                         "(ysqiiixia{sv})",
-                         a->id,
-                         a->name,
-                         a->flags,
-                         current,
-                         worst,
-                         threshold,
-                         a->pretty_value,     a->pretty_unit,
-                         NULL); 
+static Encoder *_encoder_claim(Encoder *own, EncodeFormat format)
+{
+    Encoder *e = own;
 
-  if (current > 0 && threshold > 0 && current <= threshold)
-    failed = TRUE;
+    if (!snapshot_encoder_used) {
+        snapshot_encoder_used = 1;
+        e = &snapshot_encoder;
+    } else
+        memset(own, 0, sizeof(Encoder));
 
-  if (worst > 0 && threshold > 0 && worst <= threshold)
-    failed_in_the_past = TRUE;
+    encode_reset(e, format);
+    return e;
+}
 
-  if (failed)
-    data->num_attributes_failing += 1;
+static void _encoder_done(Encoder *e)
+{
+    if (e == &snapshot_encoder)
+        snapshot_encoder_used = 0;
+    else
+        encode_free(e);
+}
 
-  if (failed_in_the_past)
-    data->num_attributes_failed_in_the_past += 1;
+typedef struct {
+    Encoder *e;
+    const VendorDecoder **vendor;
+    int human_readable;
+    uint32_t count;
+} AttributeEncode;
+
+static void _encode_optional_byte(Encoder *e, int valid, uint8_t value)
+{
+    if (valid)
+        encode_uint(e, value);
+    else
+        encode_null(e);
 }
-*/
 
-static PyMethodDef Smart_methods[] = {
-    { "check_sleep_mode", (PyCFunction)Smart_check_sleep_mode, METH_NOARGS, "Check if disk is in sleep mode"},
-    { "read_data", (PyCFunction)Smart_read_data, METH_NOARGS, "Read SMART data from disk"},
-    { "identify_is_available", (PyCFunction)Smart_identify_is_available, METH_NOARGS, "Check identify is available"},
-    { "smart_is_available", (PyCFunction)Smart_smart_is_available, METH_NOARGS, "Check if SMART is available" },
-    { "smart_status", (PyCFunction)Smart_smart_status, METH_NOARGS, "Get smart status" },
-    { "get_attributes", (PyCFunction)Smart_get_attributes, METH_NOARGS, "Get smart attributes" },
-    { "get_info", (PyCFunction)Smart_get_info, METH_VARARGS | METH_KEYWORDS, "Get smart information" },
-    { "get_identify", (PyCFunction)Smart_get_identify, METH_NOARGS, "Get smart information" },
-    { "get_size", (PyCFunction)Smart_get_size, METH_VARARGS | METH_KEYWORDS, "Get smart information" },
-
-    { "get_power_on", (PyCFunction)Smart_get_power_on, METH_VARARGS | METH_KEYWORDS, "Get the disk power-on time"},
-    { "get_power_cycle", (PyCFunction)Smart_get_power_cycle, METH_NOARGS, "Get number of power cycles" },
-    { "get_bad_sectors", (PyCFunction)Smart_get_bad_sectors, METH_VARARGS | METH_KEYWORDS, "Get number of bad sectors" },
-    { "get_temperature", (PyCFunction)Smart_get_temperature, METH_VARARGS | METH_KEYWORDS, "Get the disk temperature" },
-    { "get_overall", (PyCFunction)Smart_get_overall, METH_VARARGS | METH_KEYWORDS, "Get overall status" },
-    { "self_test", (PyCFunction)Smart_self_test, METH_VARARGS | METH_KEYWORDS, "Initiate Self-test" },
-    { "close", (PyCFunction)Smart_close, METH_NOARGS, "Close device" },
-    { NULL, NULL, 0, NULL }
-};
+static void _disk_encode_attributes(UNUSED SkDisk *d, const SkSmartAttributeParsedData *a, void* userdata)
+{
+    AttributeEncode *enc = userdata;
+    Encoder *e = enc->e;
+    const VendorDecoder *v = enc->vendor[a->id];
+    char fmt_value[32];
+    size_t mark;
+    int i, n;
 
-static PyTypeObject PyType_Smart = {
-    PyObject_HEAD_INIT(NULL)
+    for (n = 0; v && n < VENDOR_MAX_FIELDS && v->fields[n].name; n++)
+        ;
+
+    encode_begin_map(e, 16 + (enc->human_readable ? 1 : 0) + (v ? 1 : 0));
+
+    encode_key(e, "id");
+    encode_uint(e, a->id);
+    encode_key(e, "name");
+    if (a->name)
+        encode_string(e, a->name);
+    else
+        encode_null(e);
+    encode_key(e, "value");
+    _encode_optional_byte(e, a->current_value_valid, a->current_value);
+    encode_key(e, "worst");
+    _encode_optional_byte(e, a->worst_value_valid, a->worst_value);
+    encode_key(e, "threshold");
+    _encode_optional_byte(e, a->threshold_valid, a->threshold);
+    encode_key(e, "unit");
+    encode_uint(e, a->pretty_unit);
+    if (enc->human_readable) {
+        format_human_readable(fmt_value, sizeof(fmt_value), a->pretty_value, a->pretty_unit);
+        encode_key(e, "human_readable");
+        encode_string(e, fmt_value);
+    }
+    encode_key(e, "formatted_value");
+    encode_uint(e, a->pretty_value);
+    encode_key(e, "raw");
+    mark = encode_begin_array(e);
+    for (i = 0; i < 6; i++)
+        encode_uint(e, a->raw[i]);
+    encode_end_array(e, mark, 6);
+    encode_key(e, "raw_int");
+    encode_uint(e, vendor_raw48(a->raw));
+    if (v) {
+        encode_key(e, "fields");
+        encode_begin_map(e, n);
+        for (i = 0; i < n; i++) {
+            encode_key(e, v->fields[i].name);
+            encode_uint(e, vendor_field_value(&v->fields[i], a->raw));
+        }
+        encode_end_map(e);
+    }
+    encode_key(e, "updates");
+    encode_bool(e, a->online);
+    encode_key(e, "warn");
+    encode_bool(e, a->warn);
+    encode_key(e, "flags");
+    encode_uint(e, a->flags);
+    encode_key(e, "type");
+    encode_string(e, a->prefailure ? "prefail" : "old-age");
+    encode_key(e, "failed");
+    if (a->current_value && a->threshold)
+        encode_bool(e, a->current_value <= a->threshold);
+    else
+        encode_null(e);
+    encode_key(e, "good");
+    if (a->good_now_valid)
+        encode_bool(e, a->good_now);
+    else
+        encode_null(e);
+    encode_key(e, "past");
+    if (a->good_in_the_past_valid)
+        encode_bool(e, a->good_in_the_past);
+    else
+        encode_null(e);
+
+    encode_end_map(e);
+    enc->count++;
+}
+
+static void _encode_info(Encoder *e, const SkSmartParsedData *spd, int human_readable)
+{
+    encode_begin_map(e, 11);
+
+    encode_key(e, "offline_data_collection_status");
+    if (human_readable)
+        encode_string(e, sk_smart_offline_data_collection_status_to_string(spd->offline_data_collection_status));
+    else
+        encode_uint(e, spd->offline_data_collection_status);
+    encode_key(e, "total_offline_data_collection_seconds");
+    encode_uint(e, spd->total_offline_data_collection_seconds);
+    encode_key(e, "self_test_execution_status");
+    if (human_readable)
+        encode_string(e, sk_smart_self_test_execution_status_to_string(spd->self_test_execution_status));
+    else
+        encode_uint(e, spd->self_test_execution_status);
+    encode_key(e, "self_test_execution_percent_remaining");
+    encode_uint(e, spd->self_test_execution_percent_remaining);
+    encode_key(e, "conveyance_test_available");
+    encode_bool(e, spd->conveyance_test_available);
+    encode_key(e, "short_and_extended_test_available");
+    encode_bool(e, spd->short_and_extended_test_available);
+    encode_key(e, "start_test_available");
+    encode_bool(e, spd->start_test_available);
+    encode_key(e, "abort_test_available");
+    encode_bool(e, spd->abort_test_available);
+    encode_key(e, "short_test_polling_minutes");
+    encode_uint(e, spd->short_test_polling_minutes);
+    encode_key(e, "extended_test_polling_minutes");
+    encode_uint(e, spd->extended_test_polling_minutes);
+    encode_key(e, "conveyance_test_polling_minutes");
+    encode_uint(e, spd->conveyance_test_polling_minutes);
+
+    encode_end_map(e);
+}
+
+/*
+ * Write {"identify": ..., "info": ..., "attributes": [...]} for one disk,
+ * with the same keys as get_identify(), get_info() and get_attributes()
+ * plus "id" per attribute.  Parts libatasmart cannot provide are null.
+ */
+static int Smart_encode_snapshot(Smart* self, Encoder *e, int human_readable)
+{
+    const SkIdentifyParsedData *ipd;
+    const SkSmartParsedData *spd;
+    AttributeEncode enc;
+    size_t mark;
+
+    if (!self->d) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (Smart_sim_io(self) < 0)
+        return -1;
+
+    encode_begin_map(e, 3);
+
+    encode_key(e, "identify");
+    if (sk_disk_identify_parse(self->d, &ipd) < 0)
+        encode_null(e);
+    else {
+        encode_begin_map(e, 3);
+        encode_key(e, "model");
+        encode_string(e, ipd->model);
+        encode_key(e, "serial");
+        encode_string(e, ipd->serial);
+        encode_key(e, "firmware");
+        encode_string(e, ipd->firmware);
+        encode_end_map(e);
+    }
+
+    if (sk_disk_smart_parse(self->d, &spd) < 0) {
+        encode_key(e, "info");
+        encode_null(e);
+        encode_key(e, "attributes");
+        encode_null(e);
+    } else {
+        encode_key(e, "info");
+        _encode_info(e, spd, human_readable);
+
+        enc.e = e;
+        enc.vendor = Smart_vendor_table(self);
+        enc.human_readable = human_readable;
+        enc.count = 0;
+
+        encode_key(e, "attributes");
+        mark = encode_begin_array(e);
+        sk_disk_smart_parse_attributes(self->d, _disk_encode_attributes, &enc);
+        encode_end_array(e, mark, enc.count);
+    }
+
+    encode_end_map(e);
+    return 0;
+}
+
+static PyObject* _encoder_result(Encoder *e)
+{
+    PyObject *result;
+
+    if (e->failed)
+        result = PyErr_NoMemory();
+    else
+        result = PyString_FromStringAndSize(e->data, e->len);
+
+    _encoder_done(e);
+    return result;
+}
+
+static PyObject* Smart_encode(Smart* self, PyObject* args, PyObject* kwargs, EncodeFormat format)
+{
+    PyObject* human_readable = NULL;
+    Encoder own, *e;
+    int hr;
+
+    static char *kwlist[] = {"human_readable", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
+        return NULL;
+
+    if (!self->d) {
+        PyErr_SetString(Smart_error, "Disk is closed");
+        return NULL;
+    }
+
+    hr = human_readable && PyObject_IsTrue(human_readable);
+
+    e = _encoder_claim(&own, format);
+    if (Smart_encode_snapshot(self, e, hr) < 0) {
+        PyErr_Format(Smart_error, "Failed to read SMART data: (%d) %s", errno, strerror(errno));
+        _encoder_done(e);
+        return NULL;
+    }
+
+    return _encoder_result(e);
+}
+
+static PyObject* Smart_to_json(Smart* self, PyObject* args, PyObject* kwargs)
+{
+    return Smart_encode(self, args, kwargs, ENCODE_JSON);
+}
+
+static PyObject* Smart_to_msgpack(Smart* self, PyObject* args, PyObject* kwargs)
+{
+    return Smart_encode(self, args, kwargs, ENCODE_MSGPACK);
+}
+
+/* Encode a sequence of Smart objects as one array, failing disks are null */
+static PyObject* fleet_encode(PyObject* args, PyObject* kwargs, EncodeFormat format)
+{
+    PyObject *disks, *seq;
+    PyObject* human_readable = NULL;
+    Encoder own, *e;
+    Py_ssize_t i, n;
+    size_t mark;
+    int hr;
+
+    static char *kwlist[] = {"disks", "human_readable", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kwlist, &disks, &human_readable))
+        return NULL;
+
+    /* A private tuple keeps the disks alive while the GIL is released */
+    if (!(seq = PySequence_Tuple(disks)))
+        return NULL;
+
+    n = PyTuple_GET_SIZE(seq);
+    for (i = 0; i < n; i++)
+        if (!PyObject_TypeCheck(PyTuple_GET_ITEM(seq, i), &PyType_Smart)) {
+            PyErr_SetString(PyExc_TypeError, "disks must be a sequence of Smart objects");
+            Py_DECREF(seq);
+            return NULL;
+        }
+
+    hr = human_readable && PyObject_IsTrue(human_readable);
+
+    e = _encoder_claim(&own, format);
+    mark = encode_begin_array(e);
+    for (i = 0; i < n; i++) {
+        Smart *disk = (Smart*) PyTuple_GET_ITEM(seq, i);
+        size_t len = e->len;
+        int comma = e->comma;
+        int ret;
+
+        if (Smart_acquire(disk) < 0) {
+            _encoder_done(e);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        ret = Smart_encode_snapshot(disk, e, hr);
+        Smart_release(disk);
+
+        if (ret < 0) {
+            e->len = len;
+            e->comma = comma;
+            encode_null(e);
+        }
+    }
+    encode_end_array(e, mark, n);
+    Py_DECREF(seq);
+
+    return _encoder_result(e);
+}
+
+static PyObject* fleet_to_json(UNUSED PyObject* module, PyObject* args, PyObject* kwargs)
+{
+    return fleet_encode(args, kwargs, ENCODE_JSON);
+}
+
+static PyObject* fleet_to_msgpack(UNUSED PyObject* module, PyObject* args, PyObject* kwargs)
+{
+    return fleet_encode(args, kwargs, ENCODE_MSGPACK);
+}
+
+static const SgTransport *sg_transports[] = {
+    &sg_transport_linux,
+    &sg_transport_fake,
+    NULL
+};
+
+/* A Smart object for a blob disk, as if opened from a device */
+static PyObject* Smart_from_blob(const uint8_t *blob, size_t size)
+{
+    Smart *self;
+
+    if (!(self = (Smart*) PyType_GenericNew(&PyType_Smart, NULL, NULL)))
+        return NULL;
+
+    if (sk_disk_open(NULL, &self->d) < 0 || sk_disk_set_blob(self->d, blob, size) < 0) {
+        PyErr_Format(Smart_error, "Failed to load SMART data: (%d) %s", errno, strerror(errno));
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject*) self;
+}
+
+static PyObject* sg_read_many(UNUSED PyObject* module, PyObject* args, PyObject* kwargs)
+{
+    PyObject *paths, *seq, *result = NULL, *value;
+    const SgTransport *t = NULL;
+    const char *transport = "sg";
+    double timeout = 5.0;
+    int max_inflight = 64;
+    SgDevice *devs;
+    Py_ssize_t i, n;
+    int ret;
+
+    static char *kwlist[] = {"paths", "timeout", "max_inflight", "transport", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|dis", kwlist, &paths, &timeout, &max_inflight, &transport))
+        return NULL;
+
+    for (i = 0; sg_transports[i]; i++)
+        if (!strcmp(transport, sg_transports[i]->name))
+            t = sg_transports[i];
+
+    if (!t) {
+        PyErr_Format(PyExc_ValueError, "unknown transport: %s", transport);
+        return NULL;
+    }
+
+    if (!(timeout >= 0 && timeout * 1000 <= SG_MAX_TIMEOUT_MS)) {
+        PyErr_Format(PyExc_ValueError, "timeout must be between 0 and %d seconds", SG_MAX_TIMEOUT_MS / 1000);
+        return NULL;
+    }
+
+    /* A private tuple keeps the path strings alive while the GIL is released */
+    if (!(seq = PySequence_Tuple(paths)))
+        return NULL;
+
+    n = PyTuple_GET_SIZE(seq);
+    if (!(devs = PyMem_Malloc(n ? n * sizeof(SgDevice) : 1))) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    for (i = 0; i < n; i++) {
+        const char *path = PyString_AsString(PyTuple_GET_ITEM(seq, i));
+
+        if (!path)
+            goto finish;
+        sg_device_init(&devs[i], path);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = sg_engine_run(t, devs, n, max_inflight, (unsigned) (timeout * 1000));
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
+        PyErr_Format(Smart_error, "Failed to run SG_IO engine: (%d) %s", errno, strerror(errno));
+        goto finish;
+    }
+
+    result = PyDict_New();
+    for (i = 0; i < n; i++) {
+        if (devs[i].error)
+            value = PyObject_CallFunction(Smart_error, "is", devs[i].error, strerror(devs[i].error));
+        else
+            value = Smart_from_blob(devs[i].blob, devs[i].blob_size);
+
+        if (!value) {
+            Py_CLEAR(result);
+            goto finish;
+        }
+        PyDict_SetItem(result, PyTuple_GET_ITEM(seq, i), value);
+        Py_DECREF(value);
+    }
+
+finish:
+    PyMem_Free(devs);
+    Py_DECREF(seq);
+    return result;
+}
+
+static PyObject* Smart_get_info(Smart* self, PyObject* args, PyObject* kwargs)
+{
+    int ret;
+    const SkSmartParsedData *spd;
+
+    PyObject* dict = NULL;
+    PyObject* human_readable = NULL;
+
+    static char *kwlist[] = {"human_readable", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &human_readable))
+        return NULL;
+
+    dict = PyDict_New();
+
+
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_smart_parse(self->d, &spd)) < 0)
+    {
+        PyErr_SetString(Smart_error, "SMART info parsing error");
+        return NULL;
+    }
+
+    if (human_readable && PyObject_IsTrue(human_readable))
+        PyDict_SetItem(dict, 
+            Py_BuildValue("s", "offline_data_collection_status"), 
+            Py_BuildValue("s", sk_smart_offline_data_collection_status_to_string(spd->offline_data_collection_status)));
+    else
+        PyDict_SetItem(dict, 
+            Py_BuildValue("s", "offline_data_collection_status"), 
+            Py_BuildValue("K", spd->offline_data_collection_status));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "total_offline_data_collection_seconds"), 
+        Py_BuildValue("K", spd->total_offline_data_collection_seconds));
+
+    if (human_readable && PyObject_IsTrue(human_readable))
+        PyDict_SetItem(dict, 
+            Py_BuildValue("s", "self_test_execution_status"), 
+            Py_BuildValue("s", sk_smart_self_test_execution_status_to_string(spd->self_test_execution_status)));
+    else
+        PyDict_SetItem(dict, 
+            Py_BuildValue("s", "self_test_execution_status"), 
+            Py_BuildValue("K", spd->self_test_execution_status));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "self_test_execution_percent_remaining"), 
+        Py_BuildValue("K", spd->self_test_execution_percent_remaining));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "conveyance_test_available"), 
+        Py_BuildValue("O", PyBool_FromLong(spd->conveyance_test_available)));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "short_and_extended_test_available"), 
+        Py_BuildValue("O", PyBool_FromLong(spd->short_and_extended_test_available)));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "start_test_available"), 
+        Py_BuildValue("O", PyBool_FromLong(spd->start_test_available)));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "abort_test_available"), 
+        Py_BuildValue("O", PyBool_FromLong(spd->abort_test_available)));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "short_test_polling_minutes"), 
+        Py_BuildValue("K", spd->short_test_polling_minutes));
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "extended_test_polling_minutes"), 
+        Py_BuildValue("K", spd->extended_test_polling_minutes));
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "conveyance_test_polling_minutes"), 
+        Py_BuildValue("K", spd->conveyance_test_polling_minutes));
+
+    return dict;
+}
+
+static PyObject* Smart_get_identify(Smart* self)
+{
+    int ret;
+    const SkIdentifyParsedData *ipd;
+
+    PyObject* dict = NULL;
+
+    dict = PyDict_New();
+
+
+    if ((ret = Smart_sim_io(self)) < 0 || (ret = sk_disk_identify_parse(self->d, &ipd)) < 0)
+    {
+	    PyErr_SetString(Smart_error, "SMART identify  parsing error");
+	    return NULL;
+    }
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "model"), 
+        Py_BuildValue("s", ipd->model));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "serial"), 
+        Py_BuildValue("s", ipd->serial));
+
+    PyDict_SetItem(dict, 
+        Py_BuildValue("s", "firmware"), 
+        Py_BuildValue("s", ipd->firmware));
+
+    return dict;
+}
+
+static PyObject *Smart_self_test(Smart *self, PyObject* args, PyObject* kwargs)
+{
+    int ret;
+    char test_type = 0;
+
+    static char *kwlist[] = {"test_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "b", kwlist, &test_type))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (self->sim)
+        ret = sim_disk_self_test(self->sim, test_type);
+    else
+        ret = sk_disk_smart_self_test(self->d, test_type);
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
+        PyErr_Format(Smart_error, "Failed to read SMART data: (%d) %s", errno, strerror(errno));
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+/*
+static void
+_parse_attr_cb (SkDisk                           *d,
+               const SkSmartAttributeParsedData *a,
+               void                             *user_data)
+{
+  PyObject* data = user_data;
+  gboolean failed = FALSE;
+  gboolean failed_in_the_past = FALSE;
+  gint current, worst, threshold;
+
+  current =   a->current_value_valid ? a->current_value : -1;
+  worst =     a->worst_value_valid   ? a->worst_value : -1;
+  threshold = a->threshold_valid     ? a->threshold : -1;
+
+  g_variant_builder_add (&data->builder,
+                         "(ysqiiixia{sv})",
+                         a->id,
+                         a->name,
+                         a->flags,
+                         current,
+                         worst,
+                         threshold,
+                         a->pretty_value,     a->pretty_unit,
+                         NULL); 
+
+  if (current > 0 && threshold > 0 && current <= threshold)
+    failed = TRUE;
+
+  if (worst > 0 && threshold > 0 && worst <= threshold)
+    failed_in_the_past = TRUE;
+
+  if (failed)
+    data->num_attributes_failing += 1;
+
+  if (failed_in_the_past)
+    data->num_attributes_failed_in_the_past += 1;
+}
+*/
+
+/* Method table entries, each runs its method with the disk lock held */
+#define SMART_LOCKED_NOARGS(method)                                     \
+static PyObject* method##_locked(Smart* self)                           \
+{                                                                       \
+    PyObject *result;                                                   \
+                                                                        \
+    if (Smart_acquire(self) < 0)                                        \
+        return NULL;                                                    \
+    result = method(self);                                              \
+    Smart_release(self);                                                \
+    return result;                                                      \
+}
+
+#define SMART_LOCKED(method)                                            \
+static PyObject* method##_locked(Smart* self, PyObject* args, PyObject* kwargs) \
+{                                                                       \
+    PyObject *result;                                                   \
+                                                                        \
+    if (Smart_acquire(self) < 0)                                        \
+        return NULL;                                                    \
+    result = method(self, args, kwargs);                                \
+    Smart_release(self);                                                \
+    return result;                                                      \
+}
+
+SMART_LOCKED_NOARGS(Smart_check_sleep_mode)
+SMART_LOCKED_NOARGS(Smart_read_data)
+SMART_LOCKED_NOARGS(Smart_identify_is_available)
+SMART_LOCKED_NOARGS(Smart_smart_is_available)
+SMART_LOCKED_NOARGS(Smart_smart_status)
+SMART_LOCKED_NOARGS(Smart_get_attributes)
+SMART_LOCKED_NOARGS(Smart_get_identify)
+SMART_LOCKED_NOARGS(Smart_get_power_cycle)
+SMART_LOCKED_NOARGS(Smart_close)
+SMART_LOCKED(Smart_visit_attributes)
+SMART_LOCKED(Smart_get_info)
+SMART_LOCKED(Smart_to_json)
+SMART_LOCKED(Smart_to_msgpack)
+SMART_LOCKED(Smart_get_size)
+SMART_LOCKED(Smart_get_power_on)
+SMART_LOCKED(Smart_get_bad_sectors)
+SMART_LOCKED(Smart_get_temperature)
+SMART_LOCKED(Smart_get_overall)
+SMART_LOCKED(Smart_self_test)
+
+static PyMethodDef Smart_methods[] = {
+    { "check_sleep_mode", (PyCFunction)Smart_check_sleep_mode_locked, METH_NOARGS, "Check if disk is in sleep mode"},
+    { "read_data", (PyCFunction)Smart_read_data_locked, METH_NOARGS, "Read SMART data from disk"},
+    { "identify_is_available", (PyCFunction)Smart_identify_is_available_locked, METH_NOARGS, "Check identify is available"},
+    { "smart_is_available", (PyCFunction)Smart_smart_is_available_locked, METH_NOARGS, "Check if SMART is available" },
+    { "smart_status", (PyCFunction)Smart_smart_status_locked, METH_NOARGS, "Get smart status" },
+    { "get_attributes", (PyCFunction)Smart_get_attributes_locked, METH_NOARGS, "Get smart attributes" },
+    { "visit_attributes", (PyCFunction)Smart_visit_attributes_locked, METH_VARARGS | METH_KEYWORDS, "Call callback(*fields) for each smart attribute, optionally only for the given ids" },
+    { "get_info", (PyCFunction)Smart_get_info_locked, METH_VARARGS | METH_KEYWORDS, "Get smart information" },
+    { "get_identify", (PyCFunction)Smart_get_identify_locked, METH_NOARGS, "Get smart information" },
+    { "to_json", (PyCFunction)Smart_to_json_locked, METH_VARARGS | METH_KEYWORDS, "Get identify, info and attributes as JSON" },
+    { "to_msgpack", (PyCFunction)Smart_to_msgpack_locked, METH_VARARGS | METH_KEYWORDS, "Get identify, info and attributes as MessagePack" },
+    { "get_size", (PyCFunction)Smart_get_size_locked, METH_VARARGS | METH_KEYWORDS, "Get smart information" },
+
+    { "get_power_on", (PyCFunction)Smart_get_power_on_locked, METH_VARARGS | METH_KEYWORDS, "Get the disk power-on time"},
+    { "get_power_cycle", (PyCFunction)Smart_get_power_cycle_locked, METH_NOARGS, "Get number of power cycles" },
+    { "get_bad_sectors", (PyCFunction)Smart_get_bad_sectors_locked, METH_VARARGS | METH_KEYWORDS, "Get number of bad sectors" },
+    { "get_temperature", (PyCFunction)Smart_get_temperature_locked, METH_VARARGS | METH_KEYWORDS, "Get the disk temperature" },
+    { "get_overall", (PyCFunction)Smart_get_overall_locked, METH_VARARGS | METH_KEYWORDS, "Get overall status" },
+    { "self_test", (PyCFunction)Smart_self_test_locked, METH_VARARGS | METH_KEYWORDS, "Initiate Self-test" },
+    { "close", (PyCFunction)Smart_close_locked, METH_NOARGS, "Close device" },
+    { NULL, NULL, 0, NULL }
+};
+
+typedef struct {
+    PyObject_HEAD
+    FleetTable table;
+    PyObject *index;                /* key -> row */
+    PyObject *keys;                 /* row -> key */
+    PyObject *enclosure_index;      /* enclosure -> group */
+    PyObject *enclosures;           /* group -> enclosure */
+} Fleet;
+
+typedef struct {
+    double reallocated;
+    double pending;
+} FleetAttributes;
+
+static int Fleet_init(Fleet* self, PyObject* args, PyObject* kwargs)
+{
+    static char *kwlist[] = {NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "", kwlist))
+        return -1;
+
+    if (self->index)
+        return 0;
+
+    self->index = PyDict_New();
+    self->keys = PyList_New(0);
+    self->enclosure_index = PyDict_New();
+    self->enclosures = PyList_New(0);
+
+    if (!self->index || !self->keys || !self->enclosure_index || !self->enclosures)
+        return -1;
+    return 0;
+}
+
+static int Fleet_traverse(Fleet* self, visitproc visit, void* arg)
+{
+    Py_VISIT(self->index);
+    Py_VISIT(self->keys);
+    Py_VISIT(self->enclosure_index);
+    Py_VISIT(self->enclosures);
+    return 0;
+}
+
+/* Empties the containers instead of dropping them, so a Fleet that is
+ * still reachable after the collection stays usable */
+static int Fleet_clear(Fleet* self)
+{
+    fleet_table_free(&self->table);
+    if (self->index)
+        PyDict_Clear(self->index);
+    if (self->keys)
+        PyList_SetSlice(self->keys, 0, PyList_GET_SIZE(self->keys), NULL);
+    if (self->enclosure_index)
+        PyDict_Clear(self->enclosure_index);
+    if (self->enclosures)
+        PyList_SetSlice(self->enclosures, 0, PyList_GET_SIZE(self->enclosures), NULL);
+    return 0;
+}
+
+static void Fleet_dealloc(Fleet* self)
+{
+    PyObject_GC_UnTrack(self);
+    fleet_table_free(&self->table);
+    Py_XDECREF(self->index);
+    Py_XDECREF(self->keys);
+    Py_XDECREF(self->enclosure_index);
+    Py_XDECREF(self->enclosures);
+    self->ob_type->tp_free((PyObject*) self);
+}
+
+static Py_ssize_t Fleet_length(Fleet* self)
+{
+    return self->table.rows;
+}
+
+static int Fleet_group(Fleet* self, PyObject* enclosure)
+{
+    PyObject *group;
+    Py_ssize_t n;
+
+    if ((group = PyDict_GetItem(self->enclosure_index, enclosure)))
+        return PyInt_AS_LONG(group);
+
+    n = PyList_GET_SIZE(self->enclosures);
+    if (!(group = PyInt_FromSsize_t(n)))
+        return -1;
+    if (PyDict_SetItem(self->enclosure_index, enclosure, group) < 0 ||
+        PyList_Append(self->enclosures, enclosure) < 0) {
+        Py_DECREF(group);
+        return -1;
+    }
+    Py_DECREF(group);
+    return n;
+}
+
+/* Row of key, appended if it is new, with its enclosure updated */
+static int Fleet_row(Fleet* self, PyObject* key, PyObject* enclosure)
+{
+    PyObject *row;
+    int group, r;
+
+    if ((group = Fleet_group(self, enclosure)) < 0)
+        return -1;
+
+    if ((row = PyDict_GetItem(self->index, key)))
+        r = PyInt_AS_LONG(row);
+    else {
+        if ((r = fleet_table_append(&self->table)) < 0) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (!(row = PyInt_FromLong(r)))
+            goto fail;
+        if (PyDict_SetItem(self->index, key, row) < 0) {
+            Py_DECREF(row);
+            goto fail;
+        }
+        Py_DECREF(row);
+        if (PyList_Append(self->keys, key) < 0) {
+            PyDict_DelItem(self->index, key);
+            goto fail;
+        }
+    }
+
+    self->table.group[r] = group;
+    return r;
+
+fail:
+    fleet_table_remove(&self->table, r);
+    return -1;
+}
+
+static void _fleet_collect_attributes(UNUSED SkDisk *d, const SkSmartAttributeParsedData *a, void* userdata)
+{
+    FleetAttributes *f = userdata;
+
+    /* As for bad_sectors, use libatasmart's count: some vendors keep other
+     * data in the high raw bytes, which pretty_value leaves out */
+    if (a->pretty_unit != SK_SMART_ATTRIBUTE_UNIT_SECTORS)
+        return;
+
+    if (a->id == 5)
+        f->reallocated = (double) a->pretty_value;
+    else if (a->id == 197)
+        f->pending = (double) a->pretty_value;
+}
+
+/* Called with the disk lock of smart held */
+static PyObject* _fleet_update(Fleet* self, PyObject* key, Smart* smart, PyObject* enclosure)
+{
+    SkSmartOverall overall;
+    FleetAttributes attributes = { NAN, NAN };
+    uint64_t value;
+    int row, ret;
+
+    if (!smart->d) {
+        PyErr_SetString(Smart_error, "Disk is closed");
+        return NULL;
+    }
+
+    if (Smart_sim_io(smart) < 0) {
+        PyErr_Format(Smart_error, "Failed to read SMART data: (%d) %s", errno, strerror(errno));
+        return NULL;
+    }
+
+    /* Asks the device, so before the row is looked up: another thread may
+     * change the table while the GIL is released */
+    Py_BEGIN_ALLOW_THREADS
+    ret = sk_disk_smart_get_overall(smart->d, &overall);
+    Py_END_ALLOW_THREADS
+
+    if ((row = Fleet_row(self, key, enclosure)) < 0)
+        return NULL;
+
+    self->table.overall[row] = ret < 0 ? -1 : (int) overall;
+    self->table.columns[FLEET_TEMPERATURE][row] =
+        sk_disk_smart_get_temperature(smart->d, &value) < 0 ? NAN : ((double) value - 273150) / 1000;
+    self->table.columns[FLEET_POWER_ON_HOURS][row] =
+        sk_disk_smart_get_power_on(smart->d, &value) < 0 ? NAN : (double) value / (1000.0*60*60);
+    self->table.columns[FLEET_BAD_SECTORS][row] =
+        sk_disk_smart_get_bad(smart->d, &value) < 0 ? NAN : (double) value;
+
+    sk_disk_smart_parse_attributes(smart->d, _fleet_collect_attributes, &attributes);
+    self->table.columns[FLEET_REALLOCATED][row] = attributes.reallocated;
+    self->table.columns[FLEET_PENDING][row] = attributes.pending;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* Fleet_update(Fleet* self, PyObject* args, PyObject* kwargs)
+{
+    PyObject *key, *result;
+    Smart *smart;
+    PyObject *enclosure = Py_None;
+
+    static char *kwlist[] = {"key", "smart", "enclosure", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO!|O", kwlist, &key, &PyType_Smart, &smart, &enclosure))
+        return NULL;
+
+    if (Smart_acquire(smart) < 0)
+        return NULL;
+    result = _fleet_update(self, key, smart, enclosure);
+    Smart_release(smart);
+    return result;
+}
+
+static PyObject* Fleet_update_values(Fleet* self, PyObject* args, PyObject* kwargs)
+{
+    PyObject *key;
+    PyObject *enclosure = Py_None;
+    PyObject *overall = Py_None;
+    PyObject *columns[_FLEET_COLUMN_MAX];
+    double values[_FLEET_COLUMN_MAX];
+    long o = -1;
+    int i, row;
+
+    static char *kwlist[] = {"key", "enclosure", "overall", "temperature", "power_on_hours",
+                             "reallocated", "pending", "bad_sectors", NULL};
+
+    for (i = 0; i < _FLEET_COLUMN_MAX; i++)
+        columns[i] = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOOOOOO", kwlist, &key, &enclosure, &overall,
+                                     &columns[FLEET_TEMPERATURE], &columns[FLEET_POWER_ON_HOURS],
+                                     &columns[FLEET_REALLOCATED], &columns[FLEET_PENDING],
+                                     &columns[FLEET_BAD_SECTORS]))
+        return NULL;
+
+    if (overall != Py_None && (o = PyInt_AsLong(overall)) == -1 && PyErr_Occurred())
+        return NULL;
+
+    for (i = 0; i < _FLEET_COLUMN_MAX; i++) {
+        values[i] = columns[i] == Py_None ? NAN : PyFloat_AsDouble(columns[i]);
+        if (values[i] == -1.0 && PyErr_Occurred())
+            return NULL;
+    }
+
+    if ((row = Fleet_row(self, key, enclosure)) < 0)
+        return NULL;
+
+    self->table.overall[row] = o;
+    for (i = 0; i < _FLEET_COLUMN_MAX; i++)
+        self->table.columns[i][row] = values[i];
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* Fleet_remove(Fleet* self, PyObject* args)
+{
+    PyObject *key, *row, *last_key;
+    Py_ssize_t r, last;
+
+    if (!PyArg_ParseTuple(args, "O", &key))
+        return NULL;
+
+    if (!(row = PyDict_GetItem(self->index, key))) {
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+
+    /* The last row moves into the hole, keep the index in step */
+    r = PyInt_AS_LONG(row);
+    last = self->table.rows - 1;
+    last_key = PyList_GET_ITEM(self->keys, last);
+
+    if (r != last) {
+        if (PyDict_SetItem(self->index, last_key, row) < 0)
+            return NULL;
+        Py_INCREF(last_key);
+        PyList_SetItem(self->keys, r, last_key);
+    }
+    PyDict_DelItem(self->index, key);
+    PyList_SetSlice(self->keys, last, last + 1, NULL);
+    fleet_table_remove(&self->table, r);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* Fleet_keys(Fleet* self)
+{
+    return PyList_GetSlice(self->keys, 0, PyList_GET_SIZE(self->keys));
+}
+
+static int _fleet_column(const char *name)
+{
+    int column;
+
+    if ((column = fleet_column_lookup(name)) < 0)
+        PyErr_Format(PyExc_ValueError, "unknown column: %s", name);
+    return column;
+}
+
+static PyObject *_fleet_float(double v)
+{
+    if (isnan(v))
+        Py_RETURN_NONE;
+    return PyFloat_FromDouble(v);
+}
+
+/* A float, or a list of floats when q was a sequence */
+static PyObject *_fleet_percentile_value(const double *v, Py_ssize_t nq, int many)
+{
+    PyObject *list;
+    Py_ssize_t i;
+
+    if (!many)
+        return _fleet_float(v[0]);
+
+    if (!(list = PyList_New(nq)))
+        return NULL;
+    for (i = 0; i < nq; i++) {
+        PyObject *item = _fleet_float(v[i]);
+        if (!item) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+static PyObject* Fleet_percentile(Fleet* self, PyObject* args, PyObject* kwargs)
+{
+    const char *name;
+    PyObject *q, *seq = NULL, *by_enclosure = NULL, *result = NULL;
+    double *qs = NULL, *out = NULL;
+    Py_ssize_t i, nq = 1;
+    int column, many, n_groups = 0;
+
+    static char *kwlist[] = {"column", "q", "by_enclosure", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sO|O", kwlist, &name, &q, &by_enclosure))
+        return NULL;
+
+    if ((column = _fleet_column(name)) < 0)
+        return NULL;
+
+    if ((many = PySequence_Check(q))) {
+        if (!(seq = PySequence_Fast(q, "q must be a number or a sequence of numbers")))
+            return NULL;
+        nq = PySequence_Fast_GET_SIZE(seq);
+    }
+
+    if (by_enclosure && PyObject_IsTrue(by_enclosure))
+        n_groups = PyList_GET_SIZE(self->enclosures);
+
+    qs = PyMem_Malloc((nq ? nq : 1) * sizeof(double));
+    out = PyMem_Malloc((n_groups ? n_groups : 1) * (nq ? nq : 1) * sizeof(double));
+    if (!qs || !out) {
+        PyErr_NoMemory();
+        goto finish;
+    }
+
+    for (i = 0; i < nq; i++) {
+        qs[i] = PyFloat_AsDouble(many ? PySequence_Fast_GET_ITEM(seq, i) : q);
+        if (qs[i] == -1.0 && PyErr_Occurred())
+            goto finish;
+        if (qs[i] < 0 || qs[i] > 100) {
+            PyErr_SetString(PyExc_ValueError, "percentiles must be between 0 and 100");
+            goto finish;
+        }
+    }
+
+    if (fleet_percentiles(&self->table, column, qs, nq, n_groups, out) < 0) {
+        PyErr_NoMemory();
+        goto finish;
+    }
+
+    if (!n_groups) {
+        result = _fleet_percentile_value(out, nq, many);
+        goto finish;
+    }
+
+    if (!(result = PyDict_New()))
+        goto finish;
+    for (i = 0; i < n_groups; i++) {
+        PyObject *value = _fleet_percentile_value(out + i * nq, nq, many);
+
+        if (!value || PyDict_SetItem(result, PyList_GET_ITEM(self->enclosures, i), value) < 0) {
+            Py_XDECREF(value);
+            Py_CLEAR(result);
+            goto finish;
+        }
+        Py_DECREF(value);
+    }
+
+finish:
+    PyMem_Free(qs);
+    PyMem_Free(out);
+    Py_XDECREF(seq);
+    return result;
+}
+
+static PyObject* Fleet_top(Fleet* self, PyObject* args, PyObject* kwargs)
+{
+    const char *name;
+    Py_ssize_t n = 10, i, k;
+    size_t *rows;
+    PyObject *result;
+    int column;
+
+    static char *kwlist[] = {"column", "n", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|n", kwlist, &name, &n))
+        return NULL;
+
+    if ((column = _fleet_column(name)) < 0)
+        return NULL;
+
+    if (n < 0)
+        n = 0;
+    if ((size_t) n > self->table.rows)
+        n = self->table.rows;
+
+    if (!(rows = PyMem_Malloc((n ? n : 1) * sizeof(size_t))))
+        return PyErr_NoMemory();
+
+    k = fleet_top(&self->table, column, n, rows);
+
+    if ((result = PyList_New(k)))
+        for (i = 0; i < k; i++) {
+            PyObject *item = Py_BuildValue("(Od)", PyList_GET_ITEM(self->keys, rows[i]),
+                                           self->table.columns[column][rows[i]]);
+            if (!item) {
+                Py_CLEAR(result);
+                break;
+            }
+            PyList_SET_ITEM(result, i, item);
+        }
+
+    PyMem_Free(rows);
+    return result;
+}
+
+/* {overall: count}, unknown statuses counted under None */
+static PyObject *_fleet_overall_counts(const size_t *counts)
+{
+    PyObject *dict, *key, *value;
+    int i;
+
+    if (!(dict = PyDict_New()))
+        return NULL;
+
+    for (i = 0; i <= _SK_SMART_OVERALL_MAX; i++) {
+        if (i == _SK_SMART_OVERALL_MAX) {
+            key = Py_None;
+            Py_INCREF(key);
+        } else
+            key = PyInt_FromLong(i);
+        value = PyInt_FromSize_t(counts[i]);
+
+        if (!key || !value || PyDict_SetItem(dict, key, value) < 0) {
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            Py_DECREF(dict);
+            return NULL;
+        }
+        Py_DECREF(key);
+        Py_DECREF(value);
+    }
+    return dict;
+}
+
+static PyObject* Fleet_count_overall(Fleet* self, PyObject* args, PyObject* kwargs)
+{
+    PyObject *by_enclosure = NULL, *result = NULL;
+    size_t *counts;
+    int i, n_groups = 0;
+
+    static char *kwlist[] = {"by_enclosure", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &by_enclosure))
+        return NULL;
+
+    if (by_enclosure && PyObject_IsTrue(by_enclosure))
+        n_groups = PyList_GET_SIZE(self->enclosures);
+
+    if (!(counts = PyMem_Malloc((n_groups ? n_groups : 1) * (_SK_SMART_OVERALL_MAX + 1) * sizeof(size_t))))
+        return PyErr_NoMemory();
+
+    fleet_count_overall(&self->table, _SK_SMART_OVERALL_MAX, n_groups, counts);
+
+    if (!n_groups)
+        result = _fleet_overall_counts(counts);
+    else if ((result = PyDict_New()))
+        for (i = 0; i < n_groups; i++) {
+            PyObject *value = _fleet_overall_counts(counts + i * (_SK_SMART_OVERALL_MAX + 1));
+
+            if (!value || PyDict_SetItem(result, PyList_GET_ITEM(self->enclosures, i), value) < 0) {
+                Py_XDECREF(value);
+                Py_CLEAR(result);
+                break;
+            }
+            Py_DECREF(value);
+        }
+
+    PyMem_Free(counts);
+    return result;
+}
+
+static PyObject* Fleet_histogram(Fleet* self, PyObject* args, PyObject* kwargs)
+{
+    const char *name;
+    PyObject *edges, *seq, *result = NULL, *value;
+    double *e = NULL;
+    size_t *counts = NULL;
+    Py_ssize_t i, n;
+    int column;
+
+    static char *kwlist[] = {"column", "edges", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sO", kwlist, &name, &edges))
+        return NULL;
+
+    if ((column = _fleet_column(name)) < 0)
+        return NULL;
+
+    if (!(seq = PySequence_Fast(edges, "edges must be a sequence of numbers")))
+        return NULL;
+
+    if ((n = PySequence_Fast_GET_SIZE(seq)) < 2) {
+        PyErr_SetString(PyExc_ValueError, "at least two edges are needed");
+        goto finish;
+    }
+
+    e = PyMem_Malloc(n * sizeof(double));
+    counts = PyMem_Malloc((n - 1) * sizeof(size_t));
+    if (!e || !counts) {
+        PyErr_NoMemory();
+        goto finish;
+    }
+
+    for (i = 0; i < n; i++) {
+        e[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+        if (e[i] == -1.0 && PyErr_Occurred())
+            goto finish;
+        if (i > 0 && e[i] < e[i - 1]) {
+            PyErr_SetString(PyExc_ValueError, "edges must be sorted");
+            goto finish;
+        }
+    }
+
+    fleet_histogram(&self->table, column, e, n, counts);
+
+    if (!(result = PyList_New(n - 1)))
+        goto finish;
+
+    for (i = 0; i < n - 1; i++) {
+        if (!(value = PyInt_FromSize_t(counts[i]))) {
+            Py_CLEAR(result);
+            goto finish;
+        }
+        PyList_SET_ITEM(result, i, value);
+    }
+
+finish:
+    PyMem_Free(e);
+    PyMem_Free(counts);
+    Py_DECREF(seq);
+    return result;
+}
+
+static PyMethodDef module_methods[] = {
+    { "fleet_to_json", (PyCFunction)fleet_to_json, METH_VARARGS | METH_KEYWORDS, "Get the snapshots of a sequence of disks as a JSON array" },
+    { "fleet_to_msgpack", (PyCFunction)fleet_to_msgpack, METH_VARARGS | METH_KEYWORDS, "Get the snapshots of a sequence of disks as a MessagePack array" },
+    { "sg_read_many", (PyCFunction)sg_read_many, METH_VARARGS | METH_KEYWORDS, "Read identify and SMART data of many sg devices concurrently, returns {path: Smart or error}" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject PyType_Smart = {
+    PyObject_HEAD_INIT(NULL)
     0,                                              /* ob_size */
     "_atasmart.Smart",                                  /* tp_name */
     sizeof(Smart),                                  /* tp_basicsize */
@@ -752,13 +2271,80 @@ static PyTypeObject PyType_Smart = {
     0                                               /* tp_del */
 };
  
+static PyMethodDef Fleet_methods[] = {
+    { "update", (PyCFunction)Fleet_update, METH_VARARGS | METH_KEYWORDS, "Store the current reading of a Smart object under key" },
+    { "update_values", (PyCFunction)Fleet_update_values, METH_VARARGS | METH_KEYWORDS, "Store a reading given as values under key" },
+    { "remove", (PyCFunction)Fleet_remove, METH_VARARGS, "Remove the disk stored under key" },
+    { "keys", (PyCFunction)Fleet_keys, METH_NOARGS, "Get the keys of all disks" },
+    { "percentile", (PyCFunction)Fleet_percentile, METH_VARARGS | METH_KEYWORDS, "Get percentiles of a column, optionally per enclosure" },
+    { "top", (PyCFunction)Fleet_top, METH_VARARGS | METH_KEYWORDS, "Get (key, value) of the disks with the largest values of a column" },
+    { "count_overall", (PyCFunction)Fleet_count_overall, METH_VARARGS | METH_KEYWORDS, "Count disks per overall status, optionally per enclosure" },
+    { "histogram", (PyCFunction)Fleet_histogram, METH_VARARGS | METH_KEYWORDS, "Count disks per bin of a column" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PySequenceMethods Fleet_as_sequence = {
+    (lenfunc)(Fleet_length),                        /* sq_length */
+};
+
+static PyTypeObject PyType_Fleet = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                              /* ob_size */
+    "_atasmart.Fleet",                                  /* tp_name */
+    sizeof(Fleet),                                  /* tp_basicsize */
+    0,                                              /* tp_itemsize */
+    (destructor)(Fleet_dealloc),                    /* tp_dealloc */
+    0,                                              /* tp_print */
+    0,                                              /* tp_getattr */
+    0,                                              /* tp_setattr */
+    0,                                              /* tp_compare */
+    0,                                              /* tp_repr */
+    0,                                              /* tp_as_number */
+    &Fleet_as_sequence,                             /* tp_as_sequence */
+    0,                                              /* tp_as_mapping */
+    0,                                              /* tp_hash */
+    0,                                              /* tp_call */
+    0,                                              /* tp_str */
+    PyObject_GenericGetAttr,                        /* tp_getattro */
+    PyObject_GenericSetAttr,                        /* tp_setattro */
+    0,                                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC, /* tp_flags */
+    0,                                              /* tp_doc */
+    (traverseproc)(Fleet_traverse),                 /* tp_traverse */
+    (inquiry)(Fleet_clear),                         /* tp_clear */
+    0,                                              /* tp_richcompare */
+    0,                                              /* tp_weaklistoffset */
+    0,                                              /* tp_iter */
+    0,                                              /* tp_iternext */
+    Fleet_methods,                                  /* tp_methods */
+    0,                                              /* tp_members */
+    0,                                              /* tp_getset */
+    0,                                              /* tp_base */
+    0,                                              /* tp_dict */
+    0,                                              /* tp_descr_get */
+    0,                                              /* tp_descr_set */
+    0,                                              /* tp_dictoffset */
+    (initproc)(Fleet_init),                         /* tp_init */
+    0,                                              /* tp_alloc */
+    PyType_GenericNew,                              /* tp_new */
+    0,                                              /* tp_free */
+    0,                                              /* tp_is_gc */
+    0,                                              /* tp_bases */
+    0,                                              /* tp_mro */
+    0,                                              /* tp_cache */
+    0,                                              /* tp_subclasses */
+    0,                                              /* tp_weaklist */
+    0                                               /* tp_del */
+};
+ 
 PyMODINIT_FUNC init_atasmart(void)
 {
     PyObject* module;
 
     PyType_Ready(&PyType_Smart);
+    PyType_Ready(&PyType_Fleet);
 
-    module = Py_InitModule3("_atasmart", NULL, SMART_DOC_STRING);
+    module = Py_InitModule3("_atasmart", module_methods, SMART_DOC_STRING);
     Smart_error = PyErr_NewException("_atasmart.error", NULL, NULL);
 
     PyModule_AddIntConstant(module, "OVERALL_GOOD", SK_SMART_OVERALL_GOOD);
@@ -805,5 +2391,7 @@ PyMODINIT_FUNC init_atasmart(void)
     Py_INCREF(Smart_error);
 
     PyModule_AddObject(module, "Smart", (PyObject*)(&PyType_Smart));
+    Py_INCREF(&PyType_Fleet);
+    PyModule_AddObject(module, "Fleet", (PyObject*)(&PyType_Fleet));
     PyModule_AddObject(module, "error", Smart_error);
 }
\ No newline at end of file
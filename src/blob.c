@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "blob.h"
+
+size_t blob_find_section(const uint8_t *blob, size_t size, uint32_t tag)
+{
+    size_t p = 0;
+
+    while (p + 8 <= size) {
+        uint32_t t, len;
+
+        memcpy(&t, blob + p, 4);
+        memcpy(&len, blob + p + 4, 4);
+        len = ntohl(len);
+
+        if (p + 8 + len > size)
+            break;
+        if (t == tag && len == BLOB_SECTION_SIZE)
+            return p + 8;
+        p += 8 + len;
+    }
+    return 0;
+}
+
+size_t blob_put_section(uint8_t *buf, size_t len, uint32_t tag, const uint8_t *data)
+{
+    uint32_t size = htonl(BLOB_SECTION_SIZE);
+
+    memcpy(buf + len, &tag, 4);
+    memcpy(buf + len + 4, &size, 4);
+    memcpy(buf + len + 8, data, BLOB_SECTION_SIZE);
+    return len + 8 + BLOB_SECTION_SIZE;
+}
+
+int blob_read_file(const char *path, uint8_t **data, size_t *size)
+{
+    FILE *f;
+    long len;
+    uint8_t *buf;
+
+    if (!(f = fopen(path, "rb")))
+        return -1;
+
+    if (fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) < 0) {
+        fclose(f);
+        return -1;
+    }
+
+    if (!(buf = malloc(len ? len : 1))) {
+        fclose(f);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (fread(buf, 1, len, f) != (size_t) len) {
+        free(buf);
+        fclose(f);
+        errno = EIO;
+        return -1;
+    }
+
+    fclose(f);
+    *data = buf;
+    *size = len;
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef PYATASMART_BLOB_H
+#define PYATASMART_BLOB_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * libatasmart's blob format, as read by sk_disk_set_blob(): a sequence of
+ * sections, each a native tag and a big endian size followed by the data.
+ */
+
+#define BLOB_MAKE_TAG(a, b, c, d)               \
+    (((uint32_t) (d) << 24) |                   \
+     ((uint32_t) (c) << 16) |                   \
+     ((uint32_t) (b) << 8)  |                   \
+     ((uint32_t) (a)))
+
+#define BLOB_TAG_IDENTIFY         BLOB_MAKE_TAG('I', 'D', 'F', 'Y')
+#define BLOB_TAG_SMART_DATA       BLOB_MAKE_TAG('S', 'M', 'D', 'T')
+#define BLOB_TAG_SMART_THRESHOLDS BLOB_MAKE_TAG('S', 'M', 'T', 'H')
+
+#define BLOB_SECTION_SIZE 512
+
+/* Offset of the data of a 512 byte section, or 0 if there is none */
+size_t blob_find_section(const uint8_t *blob, size_t size, uint32_t tag);
+
+/* Append a 512 byte section, buf must have room for 8 + 512 more bytes */
+size_t blob_put_section(uint8_t *buf, size_t len, uint32_t tag, const uint8_t *data);
+
+/* Read a whole blob file into a malloc()ed buffer */
+int blob_read_file(const char *path, uint8_t **data, size_t *size);
+
+#endif
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "encode.h"
+
+static int encode_reserve(Encoder *e, size_t n)
+{
+    char *data;
+    size_t size;
+
+    if (e->failed)
+        return -1;
+    if (e->len + n <= e->size)
+        return 0;
+
+    for (size = e->size ? e->size : 4096; size < e->len + n; size *= 2)
+        ;
+
+    if (!(data = realloc(e->data, size))) {
+        e->failed = 1;
+        return -1;
+    }
+
+    e->data = data;
+    e->size = size;
+    return 0;
+}
+
+static void encode_bytes(Encoder *e, const void *p, size_t n)
+{
+    if (encode_reserve(e, n) < 0)
+        return;
+    memcpy(e->data + e->len, p, n);
+    e->len += n;
+}
+
+static void encode_byte(Encoder *e, uint8_t b)
+{
+    encode_bytes(e, &b, 1);
+}
+
+static void encode_be(Encoder *e, uint64_t v, int width)
+{
+    uint8_t buf[8];
+    int i;
+
+    for (i = 0; i < width; i++)
+        buf[i] = (uint8_t) (v >> (8 * (width - 1 - i)));
+    encode_bytes(e, buf, width);
+}
+
+/* JSON needs a comma before every element but the first */
+static void encode_separator(Encoder *e)
+{
+    if (e->format == ENCODE_JSON && e->comma)
+        encode_byte(e, ',');
+    e->comma = 1;
+}
+
+void encode_reset(Encoder *e, EncodeFormat format)
+{
+    e->format = format;
+    e->len = 0;
+    e->comma = 0;
+    e->failed = 0;
+}
+
+void encode_free(Encoder *e)
+{
+    free(e->data);
+    e->data = NULL;
+    e->len = e->size = 0;
+}
+
+size_t encode_begin_array(Encoder *e)
+{
+    size_t mark;
+
+    encode_separator(e);
+    mark = e->len;
+
+    if (e->format == ENCODE_JSON) {
+        encode_byte(e, '[');
+        e->comma = 0;
+    } else {
+        /* array 32, the length is filled in by encode_end_array() */
+        encode_byte(e, 0xdd);
+        encode_be(e, 0, 4);
+    }
+    return mark;
+}
+
+void encode_end_array(Encoder *e, size_t mark, uint32_t n)
+{
+    int i;
+
+    if (e->format == ENCODE_JSON) {
+        encode_byte(e, ']');
+        e->comma = 1;
+    } else if (!e->failed)
+        for (i = 0; i < 4; i++)
+            e->data[mark + 1 + i] = (char) (n >> (8 * (3 - i)));
+}
+
+void encode_begin_map(Encoder *e, uint32_t n)
+{
+    encode_separator(e);
+
+    if (e->format == ENCODE_JSON) {
+        encode_byte(e, '{');
+        e->comma = 0;
+    } else if (n < 16)
+        encode_byte(e, 0x80 | n);
+    else if (n < 0x10000) {
+        encode_byte(e, 0xde);
+        encode_be(e, n, 2);
+    } else {
+        encode_byte(e, 0xdf);
+        encode_be(e, n, 4);
+    }
+}
+
+void encode_end_map(Encoder *e)
+{
+    if (e->format == ENCODE_JSON) {
+        encode_byte(e, '}');
+        e->comma = 1;
+    }
+}
+
+static void encode_raw_string(Encoder *e, const char *s)
+{
+    size_t n = strlen(s);
+
+    if (e->format == ENCODE_MSGPACK) {
+        if (n < 32)
+            encode_byte(e, 0xa0 | n);
+        else if (n < 0x100) {
+            encode_byte(e, 0xd9);
+            encode_byte(e, n);
+        } else if (n < 0x10000) {
+            encode_byte(e, 0xda);
+            encode_be(e, n, 2);
+        } else {
+            encode_byte(e, 0xdb);
+            encode_be(e, n, 4);
+        }
+        encode_bytes(e, s, n);
+        return;
+    }
+
+    encode_byte(e, '"');
+    for (; *s; s++) {
+        uint8_t c = *s;
+
+        if (c == '"' || c == '\\') {
+            encode_byte(e, '\\');
+            encode_byte(e, c);
+        } else if (c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            encode_bytes(e, esc, 6);
+        } else
+            encode_byte(e, c);
+    }
+    encode_byte(e, '"');
+}
+
+void encode_key(Encoder *e, const char *key)
+{
+    encode_separator(e);
+    encode_raw_string(e, key);
+
+    if (e->format == ENCODE_JSON) {
+        encode_byte(e, ':');
+        e->comma = 0;
+    }
+}
+
+void encode_string(Encoder *e, const char *s)
+{
+    encode_separator(e);
+    encode_raw_string(e, s);
+}
+
+void encode_uint(Encoder *e, uint64_t v)
+{
+    encode_separator(e);
+
+    if (e->format == ENCODE_JSON) {
+        char buf[24];
+        encode_bytes(e, buf, snprintf(buf, sizeof(buf), "%llu", (unsigned long long) v));
+    } else if (v < 0x80)
+        encode_byte(e, v);
+    else if (v < 0x100) {
+        encode_byte(e, 0xcc);
+        encode_byte(e, v);
+    } else if (v < 0x10000) {
+        encode_byte(e, 0xcd);
+        encode_be(e, v, 2);
+    } else if (v < 0x100000000ULL) {
+        encode_byte(e, 0xce);
+        encode_be(e, v, 4);
+    } else {
+        encode_byte(e, 0xcf);
+        encode_be(e, v, 8);
+    }
+}
+
+void encode_bool(Encoder *e, int v)
+{
+    encode_separator(e);
+
+    if (e->format == ENCODE_JSON)
+        encode_bytes(e, v ? "true" : "false", v ? 4 : 5);
+    else
+        encode_byte(e, v ? 0xc3 : 0xc2);
+}
+
+void encode_null(Encoder *e)
+{
+    encode_separator(e);
+
+    if (e->format == ENCODE_JSON)
+        encode_bytes(e, "null", 4);
+    else
+        encode_byte(e, 0xc0);
+}
@@ -0,0 +1,44 @@
+#ifndef PYATASMART_ENCODE_H
+#define PYATASMART_ENCODE_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * Minimal streaming JSON / MessagePack writer into a growable buffer.
+ *
+ * The buffer is kept between uses, so steady state encoding does not
+ * allocate.  Map sizes must be known up front; arrays may be closed with
+ * their final length, for MessagePack the array header is patched then.
+ * Running out of memory sets failed and turns further writes into no-ops.
+ */
+
+typedef enum EncodeFormat {
+    ENCODE_JSON,
+    ENCODE_MSGPACK
+} EncodeFormat;
+
+typedef struct Encoder {
+    EncodeFormat format;
+    char *data;
+    size_t len;
+    size_t size;
+    int comma;                      /* JSON: a separator is due */
+    int failed;
+} Encoder;
+
+void   encode_reset(Encoder *e, EncodeFormat format);
+void   encode_free(Encoder *e);
+
+size_t encode_begin_array(Encoder *e);
+void   encode_end_array(Encoder *e, size_t mark, uint32_t n);
+void   encode_begin_map(Encoder *e, uint32_t n);
+void   encode_end_map(Encoder *e);
+
+void   encode_key(Encoder *e, const char *key);
+void   encode_string(Encoder *e, const char *s);
+void   encode_uint(Encoder *e, uint64_t v);
+void   encode_bool(Encoder *e, int v);
+void   encode_null(Encoder *e);
+
+#endif
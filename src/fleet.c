@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "fleet.h"
+
+const char *fleet_column_names[_FLEET_COLUMN_MAX] = {
+    "temperature",
+    "power_on_hours",
+    "reallocated",
+    "pending",
+    "bad_sectors"
+};
+
+typedef struct FleetPair {
+    int group;
+    double value;
+} FleetPair;
+
+int fleet_column_lookup(const char *name)
+{
+    int i;
+
+    for (i = 0; i < _FLEET_COLUMN_MAX; i++)
+        if (!strcmp(name, fleet_column_names[i]))
+            return i;
+    return -1;
+}
+
+static int fleet_table_grow(FleetTable *t)
+{
+    size_t capacity = t->capacity ? t->capacity * 2 : 256;
+    void *p;
+    int i;
+
+    if (!(p = realloc(t->group, capacity * sizeof(int))))
+        return -1;
+    t->group = p;
+    if (!(p = realloc(t->overall, capacity * sizeof(int))))
+        return -1;
+    t->overall = p;
+    for (i = 0; i < _FLEET_COLUMN_MAX; i++) {
+        if (!(p = realloc(t->columns[i], capacity * sizeof(double))))
+            return -1;
+        t->columns[i] = p;
+    }
+
+    t->capacity = capacity;
+    return 0;
+}
+
+int fleet_table_append(FleetTable *t)
+{
+    size_t row = t->rows;
+    int i;
+
+    if (row == t->capacity && fleet_table_grow(t) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    t->group[row] = 0;
+    t->overall[row] = -1;
+    for (i = 0; i < _FLEET_COLUMN_MAX; i++)
+        t->columns[i][row] = NAN;
+
+    t->rows++;
+    return (int) row;
+}
+
+void fleet_table_remove(FleetTable *t, size_t row)
+{
+    size_t last = t->rows - 1;
+    int i;
+
+    if (row != last) {
+        t->group[row] = t->group[last];
+        t->overall[row] = t->overall[last];
+        for (i = 0; i < _FLEET_COLUMN_MAX; i++)
+            t->columns[i][row] = t->columns[i][last];
+    }
+    t->rows--;
+}
+
+void fleet_table_free(FleetTable *t)
+{
+    int i;
+
+    free(t->group);
+    free(t->overall);
+    for (i = 0; i < _FLEET_COLUMN_MAX; i++)
+        free(t->columns[i]);
+    memset(t, 0, sizeof(FleetTable));
+}
+
+static int fleet_pair_compare(const void *a, const void *b)
+{
+    const FleetPair *x = a, *y = b;
+
+    if (x->group != y->group)
+        return x->group < y->group ? -1 : 1;
+    return x->value < y->value ? -1 : x->value > y->value;
+}
+
+static double fleet_interpolate(const FleetPair *p, size_t n, double q)
+{
+    double pos = q / 100 * (n - 1);
+    size_t lo = (size_t) floor(pos);
+    size_t hi = lo + 1 < n ? lo + 1 : lo;
+
+    return p[lo].value + (p[hi].value - p[lo].value) * (pos - lo);
+}
+
+int fleet_percentiles(const FleetTable *t, int column, const double *qs, size_t nq,
+                      int n_groups, double *out)
+{
+    const double *values = t->columns[column];
+    FleetPair *pairs;
+    size_t i, j, n = 0, start;
+
+    for (i = 0; i < (n_groups > 0 ? (size_t) n_groups : 1) * nq; i++)
+        out[i] = NAN;
+
+    if (!(pairs = malloc((t->rows ? t->rows : 1) * sizeof(FleetPair)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < t->rows; i++) {
+        if (isnan(values[i]))
+            continue;
+        pairs[n].group = n_groups > 0 ? t->group[i] : 0;
+        pairs[n].value = values[i];
+        n++;
+    }
+
+    qsort(pairs, n, sizeof(FleetPair), fleet_pair_compare);
+
+    for (start = 0; start < n; start = i) {
+        for (i = start; i < n && pairs[i].group == pairs[start].group; i++)
+            ;
+        for (j = 0; j < nq; j++)
+            out[pairs[start].group * nq + j] = fleet_interpolate(pairs + start, i - start, qs[j]);
+    }
+
+    free(pairs);
+    return 0;
+}
+
+/* Restore the min-heap property of rows[0..n) below i */
+static void fleet_sift_down(const double *values, size_t *rows, size_t n, size_t i)
+{
+    for (;;) {
+        size_t smallest = i, l = 2 * i + 1, r = 2 * i + 2, tmp;
+
+        if (l < n && values[rows[l]] < values[rows[smallest]])
+            smallest = l;
+        if (r < n && values[rows[r]] < values[rows[smallest]])
+            smallest = r;
+        if (smallest == i)
+            return;
+
+        tmp = rows[i];
+        rows[i] = rows[smallest];
+        rows[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+size_t fleet_top(const FleetTable *t, int column, size_t n, size_t *rows)
+{
+    const double *values = t->columns[column];
+    size_t i, k = 0, tmp;
+
+    if (!n)
+        return 0;
+
+    for (i = 0; i < t->rows; i++) {
+        if (isnan(values[i]))
+            continue;
+
+        if (k < n) {
+            rows[k++] = i;
+            if (k == n) {
+                size_t j = n / 2 + 1;
+                while (j-- > 0)
+                    fleet_sift_down(values, rows, n, j);
+            }
+        } else if (values[i] > values[rows[0]]) {
+            rows[0] = i;
+            fleet_sift_down(values, rows, n, 0);
+        }
+    }
+
+    if (k < n) {
+        size_t j = k / 2 + 1;
+        while (j-- > 0)
+            fleet_sift_down(values, rows, k, j);
+    }
+
+    /* Heap sort the min-heap in place, which leaves it largest first */
+    for (i = k; i > 1; i--) {
+        tmp = rows[0];
+        rows[0] = rows[i - 1];
+        rows[i - 1] = tmp;
+        fleet_sift_down(values, rows, i - 1, 0);
+    }
+
+    return k;
+}
+
+void fleet_count_overall(const FleetTable *t, int n_overall, int n_groups, size_t *counts)
+{
+    size_t width = n_overall + 1;
+    size_t i;
+
+    memset(counts, 0, (n_groups > 0 ? (size_t) n_groups : 1) * width * sizeof(size_t));
+
+    for (i = 0; i < t->rows; i++) {
+        int o = t->overall[i];
+        size_t base = n_groups > 0 ? t->group[i] * width : 0;
+
+        counts[base + (o >= 0 && o < n_overall ? (size_t) o : (size_t) n_overall)]++;
+    }
+}
+
+void fleet_histogram(const FleetTable *t, int column, const double *edges, size_t n_edges,
+                     size_t *counts)
+{
+    const double *values = t->columns[column];
+    size_t i;
+
+    if (n_edges < 2)
+        return;
+
+    memset(counts, 0, (n_edges - 1) * sizeof(size_t));
+
+    for (i = 0; i < t->rows; i++) {
+        double v = values[i];
+        size_t lo = 0, hi = n_edges - 1;
+
+        if (isnan(v) || v < edges[0] || v > edges[n_edges - 1])
+            continue;
+
+        /* Find the last edge <= v, the top edge belongs to the last bin */
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (edges[mid] <= v)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        counts[lo]++;
+    }
+}
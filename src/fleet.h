@@ -0,0 +1,59 @@
+#ifndef PYATASMART_FLEET_H
+#define PYATASMART_FLEET_H
+
+#include <stddef.h>
+
+/*
+ * Column store of per-disk readings for fleet wide aggregation.
+ *
+ * Each disk is a row with an enclosure group, its overall status and a
+ * number of numeric columns.  Unknown values are NAN (or -1 for overall)
+ * and are skipped by every query.  Rows are removed by moving the last
+ * row into the hole, so row numbers are only stable until a removal.
+ */
+
+enum {
+    FLEET_TEMPERATURE,              /* C */
+    FLEET_POWER_ON_HOURS,
+    FLEET_REALLOCATED,              /* sectors, attribute 5 */
+    FLEET_PENDING,                  /* sectors, attribute 197 */
+    FLEET_BAD_SECTORS,
+    _FLEET_COLUMN_MAX
+};
+
+typedef struct FleetTable {
+    size_t rows;
+    size_t capacity;
+    int *group;
+    int *overall;
+    double *columns[_FLEET_COLUMN_MAX];
+} FleetTable;
+
+extern const char *fleet_column_names[_FLEET_COLUMN_MAX];
+
+int    fleet_column_lookup(const char *name);
+
+int    fleet_table_append(FleetTable *t);
+void   fleet_table_remove(FleetTable *t, size_t row);
+void   fleet_table_free(FleetTable *t);
+
+/*
+ * Percentiles qs[0..nq) (0 to 100, linear interpolation between closest
+ * ranks) of a column.  With n_groups > 0 they are computed per group and
+ * out holds n_groups * nq values, otherwise nq.
+ */
+int    fleet_percentiles(const FleetTable *t, int column, const double *qs, size_t nq,
+                         int n_groups, double *out);
+
+/* Rows of the n largest values of a column, largest first */
+size_t fleet_top(const FleetTable *t, int column, size_t n, size_t *rows);
+
+/* Counts per overall status, the last of n_overall + 1 slots counting
+ * unknown ones; with n_groups > 0 one such block per group */
+void   fleet_count_overall(const FleetTable *t, int n_overall, int n_groups, size_t *counts);
+
+/* Counts per [edges[i], edges[i + 1]), the last bin includes its upper edge */
+void   fleet_histogram(const FleetTable *t, int column, const double *edges, size_t n_edges,
+                       size_t *counts);
+
+#endif
@@ -0,0 +1,438 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/major.h>
+
+#include "sgio.h"
+
+#define ATA_PASS_THROUGH_16     0x85
+#define ATA_PROTOCOL_PIO_IN     4
+#define ATA_IDENTIFY_DEVICE     0xec
+#define ATA_SMART               0xb0
+#define ATA_SMART_READ_DATA     0xd0
+#define ATA_SMART_READ_THRESHOLDS 0xd1
+
+#define SCSI_CHECK_CONDITION    0x02
+#define SG_DRIVER_SENSE         0x08
+
+#define SG_MAX_EVENTS 64
+
+#ifndef SCSI_GENERIC_MAJOR
+#define SCSI_GENERIC_MAJOR      21
+#endif
+
+static const struct {
+    uint8_t command;
+    uint8_t features;
+    uint8_t lba_low;
+    uint32_t tag;
+    int optional;                   /* the blob is still usable without it */
+} sg_steps[SG_STEPS] = {
+    { ATA_IDENTIFY_DEVICE, 0, 0, BLOB_TAG_IDENTIFY, 0 },
+    { ATA_SMART, ATA_SMART_READ_DATA, 0, BLOB_TAG_SMART_DATA, 1 },
+    { ATA_SMART, ATA_SMART_READ_THRESHOLDS, 1, BLOB_TAG_SMART_THRESHOLDS, 1 },
+};
+
+/* Linux sg driver */
+
+/* Only sg nodes take an sg_io_hdr_t through write(), on a block device
+ * it would land in the first sector.  Block devices answer
+ * SG_GET_VERSION_NUM too, so check the node itself. */
+static int sg_linux_is_sg(const struct stat *st)
+{
+    return S_ISCHR(st->st_mode) && major(st->st_rdev) == SCSI_GENERIC_MAJOR;
+}
+
+static int sg_linux_open(const char *path)
+{
+    struct stat st;
+    dev_t rdev;
+    int fd, version;
+
+    if (stat(path, &st) < 0)
+        return -1;
+    if (!sg_linux_is_sg(&st)) {
+        errno = ENOTTY;
+        return -1;
+    }
+    rdev = st.st_rdev;
+
+    if ((fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0)
+        return -1;
+
+    /* The path may have been replaced since the stat() */
+    if (fstat(fd, &st) < 0 || !sg_linux_is_sg(&st) || st.st_rdev != rdev ||
+        ioctl(fd, SG_GET_VERSION_NUM, &version) < 0 || version < 30000) {
+        close(fd);
+        errno = ENOTTY;
+        return -1;
+    }
+    return fd;
+}
+
+static int sg_linux_submit(int fd, sg_io_hdr_t *hdr)
+{
+    ssize_t n;
+
+    if ((n = write(fd, hdr, sizeof(*hdr))) < 0)
+        return -1;
+    if (n != sizeof(*hdr)) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int sg_linux_receive(int fd, sg_io_hdr_t *hdr)
+{
+    ssize_t n;
+
+    if ((n = read(fd, hdr, sizeof(*hdr))) < 0)
+        return -1;
+    if (n != sizeof(*hdr)) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static void sg_linux_close(int fd)
+{
+    close(fd);
+}
+
+const SgTransport sg_transport_linux = {
+    "sg",
+    sg_linux_open,
+    sg_linux_submit,
+    sg_linux_receive,
+    sg_linux_close
+};
+
+/*
+ * In process fake: the device path names a libatasmart blob whose
+ * sections answer the commands, an eventfd signals the completions.
+ */
+
+typedef struct SgFake {
+    uint8_t *blob;
+    size_t size;
+    sg_io_hdr_t done;
+} SgFake;
+
+static pthread_mutex_t sg_fakes_lock = PTHREAD_MUTEX_INITIALIZER;
+static SgFake **sg_fakes;
+static int sg_fakes_size;
+
+static SgFake *sg_fake_get(int fd)
+{
+    SgFake *f;
+
+    pthread_mutex_lock(&sg_fakes_lock);
+    f = fd < sg_fakes_size ? sg_fakes[fd] : NULL;
+    pthread_mutex_unlock(&sg_fakes_lock);
+    return f;
+}
+
+static int sg_fake_open(const char *path)
+{
+    SgFake *f;
+    int fd;
+
+    if (!(f = calloc(1, sizeof(SgFake)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (blob_read_file(path, &f->blob, &f->size) < 0) {
+        free(f);
+        return -1;
+    }
+
+    if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        goto fail;
+
+    pthread_mutex_lock(&sg_fakes_lock);
+    if (fd >= sg_fakes_size) {
+        int size = fd + 64;
+        SgFake **fakes = realloc(sg_fakes, size * sizeof(SgFake*));
+
+        if (!fakes) {
+            pthread_mutex_unlock(&sg_fakes_lock);
+            close(fd);
+            errno = ENOMEM;
+            goto fail;
+        }
+        memset(fakes + sg_fakes_size, 0, (size - sg_fakes_size) * sizeof(SgFake*));
+        sg_fakes = fakes;
+        sg_fakes_size = size;
+    }
+    sg_fakes[fd] = f;
+    pthread_mutex_unlock(&sg_fakes_lock);
+    return fd;
+
+fail:
+    free(f->blob);
+    free(f);
+    return -1;
+}
+
+static int sg_fake_submit(int fd, sg_io_hdr_t *hdr)
+{
+    SgFake *f = sg_fake_get(fd);
+    const uint8_t *cdb = hdr->cmdp;
+    uint64_t one = 1;
+    size_t p = 0;
+    int i;
+
+    if (!f) {
+        errno = EBADF;
+        return -1;
+    }
+
+    for (i = 0; i < SG_STEPS; i++)
+        if (cdb[14] == sg_steps[i].command && cdb[4] == sg_steps[i].features)
+            p = blob_find_section(f->blob, f->size, sg_steps[i].tag);
+
+    f->done = *hdr;
+    if (p && hdr->dxfer_len >= BLOB_SECTION_SIZE) {
+        memcpy(hdr->dxferp, f->blob + p, BLOB_SECTION_SIZE);
+        f->done.status = 0;
+        f->done.driver_status = 0;
+        f->done.info = SG_INFO_OK;
+        f->done.resid = hdr->dxfer_len - BLOB_SECTION_SIZE;
+    } else {
+        /* ABORTED COMMAND, as a SAT layer reports a rejected ATA command */
+        memset(hdr->sbp, 0, hdr->mx_sb_len);
+        if (hdr->mx_sb_len >= 2) {
+            hdr->sbp[0] = 0x72;
+            hdr->sbp[1] = 0x0b;
+        }
+        f->done.status = SCSI_CHECK_CONDITION;
+        f->done.driver_status = SG_DRIVER_SENSE;
+        f->done.info = SG_INFO_CHECK;
+        f->done.sb_len_wr = hdr->mx_sb_len < 8 ? hdr->mx_sb_len : 8;
+        f->done.resid = hdr->dxfer_len;
+    }
+
+    return write(fd, &one, sizeof(one)) == sizeof(one) ? 0 : -1;
+}
+
+static int sg_fake_receive(int fd, sg_io_hdr_t *hdr)
+{
+    SgFake *f = sg_fake_get(fd);
+    uint64_t n;
+
+    if (!f) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (read(fd, &n, sizeof(n)) < 0)
+        return -1;
+
+    *hdr = f->done;
+    return 0;
+}
+
+static void sg_fake_close(int fd)
+{
+    SgFake *f;
+
+    pthread_mutex_lock(&sg_fakes_lock);
+    f = fd < sg_fakes_size ? sg_fakes[fd] : NULL;
+    if (f)
+        sg_fakes[fd] = NULL;
+    pthread_mutex_unlock(&sg_fakes_lock);
+
+    if (f) {
+        free(f->blob);
+        free(f);
+    }
+    close(fd);
+}
+
+const SgTransport sg_transport_fake = {
+    "fake",
+    sg_fake_open,
+    sg_fake_submit,
+    sg_fake_receive,
+    sg_fake_close
+};
+
+/* Engine */
+
+void sg_device_init(SgDevice *dev, const char *path)
+{
+    memset(dev, 0, sizeof(SgDevice));
+    dev->path = path;
+    dev->fd = -1;
+}
+
+static void sg_device_prepare(SgDevice *dev, unsigned timeout_ms)
+{
+    int step = dev->step;
+
+    memset(dev->cdb, 0, sizeof(dev->cdb));
+    dev->cdb[0] = ATA_PASS_THROUGH_16;
+    dev->cdb[1] = ATA_PROTOCOL_PIO_IN << 1;
+    dev->cdb[2] = 0x0e;             /* T_DIR in, BYT_BLOK, length in SECTOR COUNT */
+    dev->cdb[4] = sg_steps[step].features;
+    dev->cdb[6] = 1;
+    dev->cdb[8] = sg_steps[step].lba_low;
+    if (sg_steps[step].command == ATA_SMART) {
+        dev->cdb[10] = 0x4f;
+        dev->cdb[12] = 0xc2;
+    }
+    dev->cdb[14] = sg_steps[step].command;
+
+    memset(&dev->hdr, 0, sizeof(dev->hdr));
+    dev->hdr.interface_id = 'S';
+    dev->hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    dev->hdr.cmd_len = sizeof(dev->cdb);
+    dev->hdr.mx_sb_len = sizeof(dev->sense);
+    dev->hdr.dxfer_len = BLOB_SECTION_SIZE;
+    dev->hdr.dxferp = dev->data[step];
+    dev->hdr.cmdp = dev->cdb;
+    dev->hdr.sbp = dev->sense;
+    dev->hdr.timeout = timeout_ms;
+    dev->hdr.pack_id = step;
+    dev->hdr.usr_ptr = dev;
+}
+
+static void sg_device_finish(const SgTransport *t, int epfd, SgDevice *dev, int error)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+    t->close(dev->fd);
+    dev->fd = -1;
+    dev->error = error;
+}
+
+/* Returns 1 while the device has a command in flight, 0 once it is done */
+static int sg_device_start(const SgTransport *t, int epfd, SgDevice *dev, unsigned timeout_ms)
+{
+    struct epoll_event ev;
+
+    if ((dev->fd = t->open(dev->path)) < 0) {
+        dev->error = errno;
+        return 0;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = dev;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, dev->fd, &ev) < 0) {
+        dev->error = errno;
+        t->close(dev->fd);
+        dev->fd = -1;
+        return 0;
+    }
+
+    sg_device_prepare(dev, timeout_ms);
+    if (t->submit(dev->fd, &dev->hdr) < 0) {
+        sg_device_finish(t, epfd, dev, errno);
+        return 0;
+    }
+    return 1;
+}
+
+static int sg_device_complete(const SgTransport *t, int epfd, SgDevice *dev, unsigned timeout_ms)
+{
+    int ok;
+
+    if (t->receive(dev->fd, &dev->hdr) < 0) {
+        if (errno == EAGAIN)
+            return 1;
+        sg_device_finish(t, epfd, dev, errno);
+        return 0;
+    }
+
+    ok = (dev->hdr.info & SG_INFO_OK_MASK) == SG_INFO_OK;
+    if (!ok && !sg_steps[dev->step].optional) {
+        sg_device_finish(t, epfd, dev, EIO);
+        return 0;
+    }
+
+    if (ok)
+        dev->blob_size = blob_put_section(dev->blob, dev->blob_size, sg_steps[dev->step].tag, dev->data[dev->step]);
+
+    /* Without SMART data there is no point in asking for thresholds */
+    if (ok && ++dev->step < SG_STEPS) {
+        sg_device_prepare(dev, timeout_ms);
+        if (t->submit(dev->fd, &dev->hdr) < 0) {
+            sg_device_finish(t, epfd, dev, errno);
+            return 0;
+        }
+        return 1;
+    }
+
+    sg_device_finish(t, epfd, dev, 0);
+    return 0;
+}
+
+int sg_engine_run(const SgTransport *t, SgDevice *devs, int n, int max_inflight, unsigned timeout_ms)
+{
+    struct epoll_event events[SG_MAX_EVENTS];
+    int epfd, next = 0, inflight = 0;
+    int i, k;
+
+    if (timeout_ms > SG_MAX_TIMEOUT_MS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return -1;
+
+    if (max_inflight < 1)
+        max_inflight = 1;
+
+    while (next < n || inflight > 0) {
+        while (next < n && inflight < max_inflight)
+            inflight += sg_device_start(t, epfd, &devs[next++], timeout_ms);
+
+        if (!inflight)
+            continue;
+
+        /* The kernel times out commands itself, this only catches a stuck transport */
+        if ((k = epoll_wait(epfd, events, SG_MAX_EVENTS, (int) timeout_ms + 1000)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (k == 0) {
+            for (i = 0; i < next; i++)
+                if (devs[i].fd >= 0) {
+                    sg_device_finish(t, epfd, &devs[i], ETIMEDOUT);
+                    inflight--;
+                }
+            continue;
+        }
+
+        for (i = 0; i < k; i++)
+            if (!sg_device_complete(t, epfd, events[i].data.ptr, timeout_ms))
+                inflight--;
+    }
+
+    if (inflight > 0) {
+        int saved_errno = errno;
+
+        for (i = 0; i < next; i++)
+            if (devs[i].fd >= 0)
+                sg_device_finish(t, epfd, &devs[i], saved_errno);
+        close(epfd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    close(epfd);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef PYATASMART_SGIO_H
+#define PYATASMART_SGIO_H
+
+#include <limits.h>
+#include <scsi/sg.h>
+
+#include "blob.h"
+
+/*
+ * Asynchronous ATA PASS-THROUGH over the sg driver's write()/read()
+ * interface.
+ *
+ * sg_engine_run() reads IDENTIFY, SMART READ DATA and SMART READ
+ * THRESHOLDS from many devices from a single epoll loop, one command in
+ * flight per device, and leaves the results as a libatasmart blob ready
+ * for sk_disk_set_blob().  It uses no Python objects and may be run
+ * without the GIL.
+ *
+ * Device access goes through an SgTransport: sg_transport_linux talks to
+ * /dev/sg* nodes, sg_transport_fake answers from blob files in process.
+ * A transport's fds must become readable when a completion is pending.
+ */
+
+typedef struct SgTransport {
+    const char *name;
+    int  (*open)(const char *path);
+    int  (*submit)(int fd, sg_io_hdr_t *hdr);
+    int  (*receive)(int fd, sg_io_hdr_t *hdr);
+    void (*close)(int fd);
+} SgTransport;
+
+extern const SgTransport sg_transport_linux;
+extern const SgTransport sg_transport_fake;
+
+#define SG_STEPS 3
+
+/* Leaves room for the engine's own grace period in an int */
+#define SG_MAX_TIMEOUT_MS (INT_MAX - 1000)
+
+typedef struct SgDevice {
+    const char *path;
+    int fd;
+    int step;
+    int error;                      /* errno of the failure, 0 on success */
+    sg_io_hdr_t hdr;
+    uint8_t cdb[16];
+    uint8_t sense[32];
+    uint8_t data[SG_STEPS][BLOB_SECTION_SIZE];
+
+    uint8_t blob[SG_STEPS * (8 + BLOB_SECTION_SIZE)];
+    size_t blob_size;
+} SgDevice;
+
+void sg_device_init(SgDevice *dev, const char *path);
+
+/* Returns -1 with errno set if the loop itself fails, per device errors
+ * are left in SgDevice.error.  timeout_ms must not exceed SG_MAX_TIMEOUT_MS. */
+int  sg_engine_run(const SgTransport *t, SgDevice *devs, int n, int max_inflight, unsigned timeout_ms);
+
+#endif
@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "blob.h"
+
+#define UNUSED __attribute__ (( __unused__ ))
+
+#define SIM_BLOB_FILE  "disk.blob"
+#define SIM_MODEL_FILE "model"
+
+#define SIM_ATTRIBUTE_COUNT  30
+#define SIM_ATTRIBUTE_SIZE   12
+
+typedef struct SimModel {
+    double time_scale;              /* simulated seconds per real second */
+    double temperature_drift;       /* C per simulated hour */
+    double temperature_swing;       /* C, amplitude of the daily cycle */
+    double temperature_period;      /* s */
+    double reallocated_rate;        /* sectors per simulated hour */
+    double pending_rate;            /* sectors per simulated hour */
+    double sleep_period;            /* s, 0 disables sleeping */
+    double sleep_fraction;          /* part of sleep_period spent asleep */
+    double latency_ms;
+    double latency_jitter_ms;
+    double spinup_ms;               /* extra latency reading a sleeping disk */
+    double error_rate;              /* probability of EIO per access */
+    double size;                    /* bytes */
+} SimModel;
+
+struct SimDisk {
+    SimModel model;
+    uint64_t rng;
+    double phase;                   /* s, per-instance offset into the cycles */
+    struct timespec opened;
+
+    uint8_t *blob;                  /* pristine blob as loaded from disk */
+    uint8_t *work;                  /* evolved copy handed to libatasmart */
+    size_t size;
+    size_t smart_data;              /* offset of the SMART data section */
+};
+
+static const struct {
+    const char *key;
+    size_t offset;
+} sim_model_keys[] = {
+    { "time_scale", offsetof(SimModel, time_scale) },
+    { "temperature_drift", offsetof(SimModel, temperature_drift) },
+    { "temperature_swing", offsetof(SimModel, temperature_swing) },
+    { "temperature_period", offsetof(SimModel, temperature_period) },
+    { "reallocated_rate", offsetof(SimModel, reallocated_rate) },
+    { "pending_rate", offsetof(SimModel, pending_rate) },
+    { "sleep_period", offsetof(SimModel, sleep_period) },
+    { "sleep_fraction", offsetof(SimModel, sleep_fraction) },
+    { "latency_ms", offsetof(SimModel, latency_ms) },
+    { "latency_jitter_ms", offsetof(SimModel, latency_jitter_ms) },
+    { "spinup_ms", offsetof(SimModel, spinup_ms) },
+    { "error_rate", offsetof(SimModel, error_rate) },
+    { "size", offsetof(SimModel, size) },
+    { NULL, 0 }
+};
+
+/* xorshift64*, good enough for jitter and error injection */
+static double sim_random(SimDisk *s)
+{
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    return (double) ((s->rng * 2685821657736338717ULL) >> 11) / (double) (1ULL << 53);
+}
+
+static uint64_t sim_hash(const char *str)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (; *str; str++) {
+        h ^= (uint8_t) *str;
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+/* Simulated seconds since the disk was opened */
+static double sim_elapsed(SimDisk *s)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - s->opened.tv_sec) +
+            (now.tv_nsec - s->opened.tv_nsec) / 1e9) * s->model.time_scale;
+}
+
+static int sim_is_asleep(SimDisk *s)
+{
+    const SimModel *m = &s->model;
+
+    if (m->sleep_period <= 0)
+        return 0;
+    return fmod(sim_elapsed(s) + s->phase, m->sleep_period) >=
+           m->sleep_period * (1 - m->sleep_fraction);
+}
+
+static void sim_delay(double ms)
+{
+    struct timespec ts;
+
+    if (ms <= 0)
+        return;
+    ts.tv_sec = (time_t) (ms / 1000);
+    ts.tv_nsec = (long) (fmod(ms, 1000) * 1000000);
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static int sim_load_model(SimModel *m, const char *path)
+{
+    FILE *f;
+    char line[256];
+
+    m->time_scale = 1.0;
+    m->temperature_period = 86400;
+    m->size = 2000398934016.0;
+
+    if (!(f = fopen(path, "r")))
+        return errno == ENOENT ? 0 : -1;
+
+    while (fgets(line, sizeof(line), f)) {
+        char key[64];
+        double value;
+        int i;
+
+        if (sscanf(line, " %63[a-z_] = %lf", key, &value) != 2)
+            continue;
+
+        for (i = 0; sim_model_keys[i].key; i++)
+            if (!strcmp(key, sim_model_keys[i].key)) {
+                *(double*) ((char*) m + sim_model_keys[i].offset) = value;
+                break;
+            }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+/* ATA strings store two characters per word, high byte first */
+static void sim_set_serial(uint8_t *identify, const char *serial)
+{
+    char field[20];
+    size_t len = strlen(serial);
+    int i;
+
+    if (len > sizeof(field))
+        serial += len - sizeof(field);
+    memset(field, ' ', sizeof(field));
+    memcpy(field, serial, strlen(serial));
+
+    for (i = 0; i < (int) sizeof(field); i += 2) {
+        identify[20 + i] = field[i + 1];
+        identify[20 + i + 1] = field[i];
+    }
+}
+
+static uint8_t *sim_attribute(uint8_t *data, uint8_t id)
+{
+    int i;
+
+    for (i = 0; i < SIM_ATTRIBUTE_COUNT; i++) {
+        uint8_t *a = data + 2 + i * SIM_ATTRIBUTE_SIZE;
+        if (a[0] == id)
+            return a;
+    }
+    return NULL;
+}
+
+static void sim_add_raw48(uint8_t *data, uint8_t id, uint64_t delta)
+{
+    uint8_t *a;
+    uint64_t raw = 0;
+    int i;
+
+    if (!delta || !(a = sim_attribute(data, id)))
+        return;
+
+    for (i = 5; i >= 0; i--)
+        raw = (raw << 8) | a[5 + i];
+    raw += delta;
+    for (i = 0; i < 6; i++)
+        a[5 + i] = (uint8_t) (raw >> (8 * i));
+}
+
+static void sim_set_temperature(uint8_t *data, uint8_t id, double delta)
+{
+    uint8_t *a;
+    double t;
+
+    if (!(a = sim_attribute(data, id)))
+        return;
+
+    t = a[5] + delta;
+    a[5] = (uint8_t) (t < 0 ? 0 : t > 127 ? 127 : t + 0.5);
+}
+
+static void sim_evolve(SimDisk *s)
+{
+    const SimModel *m = &s->model;
+    uint8_t *data;
+    double t, hours, dt;
+    uint8_t sum = 0;
+    int i, checksummed;
+
+    memcpy(s->work, s->blob, s->size);
+    if (!s->smart_data)
+        return;
+
+    data = s->work + s->smart_data;
+    for (i = 0; i < BLOB_SECTION_SIZE; i++)
+        sum += data[i];
+    checksummed = sum == 0;
+
+    t = sim_elapsed(s);
+    hours = t / 3600;
+
+    dt = m->temperature_drift * hours;
+    if (m->temperature_period > 0)
+        dt += m->temperature_swing * sin(2 * M_PI * (t + s->phase) / m->temperature_period);
+    sim_set_temperature(data, 194, dt);
+    sim_set_temperature(data, 190, dt);
+
+    sim_add_raw48(data, 9, (uint64_t) hours);
+    sim_add_raw48(data, 5, (uint64_t) (m->reallocated_rate * hours));
+    sim_add_raw48(data, 197, (uint64_t) (m->pending_rate * hours));
+
+    if (checksummed) {
+        sum = 0;
+        for (i = 0; i < BLOB_SECTION_SIZE - 1; i++)
+            sum += data[i];
+        data[BLOB_SECTION_SIZE - 1] = (uint8_t) -sum;
+    }
+}
+
+int sim_disk_open(const char *spec, SimDisk **_s, SkDisk **d)
+{
+    SimDisk *s;
+    char *dir, *instance, *path;
+    size_t identify;
+    int ret = -1;
+
+    if (!(s = calloc(1, sizeof(SimDisk))) || !(dir = strdup(spec))) {
+        free(s);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if ((instance = strchr(dir, '#')))
+        *(instance++) = 0;
+
+    if (!(path = malloc(strlen(dir) + sizeof(SIM_BLOB_FILE) + sizeof(SIM_MODEL_FILE) + 2))) {
+        errno = ENOMEM;
+        goto finish;
+    }
+
+    sprintf(path, "%s/%s", dir, SIM_MODEL_FILE);
+    if (sim_load_model(&s->model, path) < 0)
+        goto finish;
+
+    sprintf(path, "%s/%s", dir, SIM_BLOB_FILE);
+    if (blob_read_file(path, &s->blob, &s->size) < 0)
+        goto finish;
+
+    if (!(s->work = malloc(s->size ? s->size : 1))) {
+        errno = ENOMEM;
+        goto finish;
+    }
+
+    s->smart_data = blob_find_section(s->blob, s->size, BLOB_TAG_SMART_DATA);
+    if (instance && *instance &&
+        (identify = blob_find_section(s->blob, s->size, BLOB_TAG_IDENTIFY)))
+        sim_set_serial(s->blob + identify, instance);
+
+    s->rng = sim_hash(instance ? instance : spec);
+    s->phase = sim_random(s) * 86400 * 7;
+    clock_gettime(CLOCK_MONOTONIC, &s->opened);
+
+    /* A nameless SkDisk is a blob disk in libatasmart */
+    if (sk_disk_open(NULL, d) < 0)
+        goto finish;
+
+    sim_evolve(s);
+    if (sk_disk_set_blob(*d, s->work, s->size) < 0) {
+        sk_disk_free(*d);
+        *d = NULL;
+        goto finish;
+    }
+
+    ret = 0;
+
+finish:
+    free(path);
+    free(dir);
+    if (ret < 0) {
+        int saved_errno = errno;
+        sim_disk_free(s);
+        errno = saved_errno;
+    } else
+        *_s = s;
+    return ret;
+}
+
+void sim_disk_free(SimDisk *s)
+{
+    if (!s)
+        return;
+    free(s->blob);
+    free(s->work);
+    free(s);
+}
+
+int sim_disk_io(SimDisk *s)
+{
+    const SimModel *m;
+
+    if (!s)
+        return 0;
+
+    m = &s->model;
+    sim_delay(m->latency_ms + m->latency_jitter_ms * sim_random(s));
+
+    if (m->error_rate > 0 && sim_random(s) < m->error_rate) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+int sim_disk_read_data(SimDisk *s, SkDisk *d)
+{
+    if (sim_is_asleep(s))
+        sim_delay(s->model.spinup_ms);
+
+    if (sim_disk_io(s) < 0)
+        return -1;
+
+    sim_evolve(s);
+    return sk_disk_set_blob(d, s->work, s->size);
+}
+
+int sim_disk_check_sleep_mode(SimDisk *s, SkBool *awake)
+{
+    if (sim_disk_io(s) < 0)
+        return -1;
+
+    *awake = !sim_is_asleep(s);
+    return 0;
+}
+
+int sim_disk_get_size(SimDisk *s, uint64_t *bytes)
+{
+    if (sim_disk_io(s) < 0)
+        return -1;
+
+    *bytes = (uint64_t) s->model.size;
+    return 0;
+}
+
+int sim_disk_self_test(SimDisk *s, UNUSED SkSmartSelfTest test)
+{
+    return sim_disk_io(s);
+}
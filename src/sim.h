@@ -0,0 +1,37 @@
+#ifndef PYATASMART_SIM_H
+#define PYATASMART_SIM_H
+
+#include <atasmart.h>
+
+/*
+ * Simulated devices, opened as "sim://<dir>[#<instance>]".
+ *
+ * <dir>/disk.blob is a libatasmart blob (as written by skdump --save) that
+ * is loaded into a blob-type SkDisk, so all parsing goes through
+ * libatasmart exactly as for a real device.  <dir>/model is an optional
+ * "key = value" file describing how the disk evolves over time and which
+ * latency and errors to inject.  <instance> seeds the per-disk variation
+ * so that many virtual disks can share one directory.
+ *
+ * Like the libatasmart calls, every function returns a negative value and
+ * sets errno on failure.
+ */
+
+#define SIM_PREFIX "sim://"
+
+typedef struct SimDisk SimDisk;
+
+int  sim_disk_open(const char *spec, SimDisk **s, SkDisk **d);
+void sim_disk_free(SimDisk *s);
+
+/* Injects latency and errors; to be called before every device access. */
+int  sim_disk_io(SimDisk *s);
+
+/* Evolves the SMART data to the current simulated time and reloads it. */
+int  sim_disk_read_data(SimDisk *s, SkDisk *d);
+
+int  sim_disk_check_sleep_mode(SimDisk *s, SkBool *awake);
+int  sim_disk_get_size(SimDisk *s, uint64_t *bytes);
+int  sim_disk_self_test(SimDisk *s, SkSmartSelfTest test);
+
+#endif
@@ -0,0 +1,64 @@
+#include <string.h>
+#include <fnmatch.h>
+
+#include "vendor.h"
+
+static const VendorDecoder vendor_decoders[] = {
+    /* Seagate error rates: error count on top of a 32 bit operation count */
+    { "ST*", 1,   { { "errors", 4, 2 }, { "operations", 0, 4 } } },
+    { "ST*", 7,   { { "errors", 4, 2 }, { "operations", 0, 4 } } },
+    { "ST*", 195, { { "errors", 4, 2 }, { "operations", 0, 4 } } },
+
+    /* Seagate command timeouts: total, and those over 5s and 7.5s */
+    { "ST*", 188, { { "total", 0, 2 }, { "over_5s", 2, 2 }, { "over_7_5s", 4, 2 } } },
+
+    /* Seagate power-on hours with the milliseconds of the current hour */
+    { "ST*", 9,   { { "hours", 0, 4 }, { "milliseconds", 4, 2 } } },
+
+    /* Seagate airflow temperature with the lifetime minimum and maximum */
+    { "ST*", 190, { { "current", 0, 1 }, { "min", 2, 1 }, { "max", 3, 1 } } },
+    { "ST*", 194, { { "current", 0, 1 }, { "min", 2, 1 } } },
+
+    /* Current, minimum and maximum temperature in the even raw bytes */
+    { "HGST*",    194, { { "current", 0, 1 }, { "min", 2, 1 }, { "max", 4, 1 } } },
+    { "Hitachi*", 194, { { "current", 0, 1 }, { "min", 2, 1 }, { "max", 4, 1 } } },
+    { "TOSHIBA*", 194, { { "current", 0, 1 }, { "min", 2, 1 }, { "max", 4, 1 } } },
+    { "WDC*",     194, { { "current", 0, 1 }, { "min", 2, 1 }, { "max", 4, 1 } } },
+
+    /* Anything else reports the current temperature in the first byte */
+    { "*", 190, { { "current", 0, 1 } } },
+    { "*", 194, { { "current", 0, 1 } } },
+
+    { NULL, 0, { { NULL, 0, 0 } } }
+};
+
+void vendor_resolve(const char *model, VendorTable table)
+{
+    const VendorDecoder *v;
+
+    memset(table, 0, sizeof(VendorTable));
+
+    for (v = vendor_decoders; v->model; v++)
+        if (!table[v->id] && fnmatch(v->model, model, 0) == 0)
+            table[v->id] = v;
+}
+
+uint64_t vendor_raw48(const uint8_t raw[6])
+{
+    return ((uint64_t) raw[0]) |
+           ((uint64_t) raw[1] << 8) |
+           ((uint64_t) raw[2] << 16) |
+           ((uint64_t) raw[3] << 24) |
+           ((uint64_t) raw[4] << 32) |
+           ((uint64_t) raw[5] << 40);
+}
+
+uint64_t vendor_field_value(const VendorField *f, const uint8_t raw[6])
+{
+    uint64_t value = 0;
+    int i;
+
+    for (i = f->width - 1; i >= 0; i--)
+        value = (value << 8) | raw[f->offset + i];
+    return value;
+}
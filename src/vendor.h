@@ -0,0 +1,35 @@
+#ifndef PYATASMART_VENDOR_H
+#define PYATASMART_VENDOR_H
+
+#include <atasmart.h>
+
+/*
+ * Vendor specific layouts of the 48 bit raw attribute value.
+ *
+ * The table in vendor.c is keyed by an fnmatch(3) pattern on the model
+ * string and an attribute id; the first matching entry wins.  A disk's
+ * decoders are resolved once into a table indexed by attribute id, so
+ * decoding a sample is a plain array lookup.
+ */
+
+#define VENDOR_MAX_FIELDS 4
+
+typedef struct VendorField {
+    const char *name;
+    uint8_t offset;                 /* first raw byte, little endian */
+    uint8_t width;                  /* in bytes */
+} VendorField;
+
+typedef struct VendorDecoder {
+    const char *model;
+    uint8_t id;
+    VendorField fields[VENDOR_MAX_FIELDS];
+} VendorDecoder;
+
+typedef const VendorDecoder *VendorTable[256];
+
+void     vendor_resolve(const char *model, VendorTable table);
+uint64_t vendor_raw48(const uint8_t raw[6]);
+uint64_t vendor_field_value(const VendorField *f, const uint8_t raw[6]);
+
+#endif